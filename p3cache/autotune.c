@@ -0,0 +1,396 @@
+/*
+ * autotune.c - Searches a parameterized family of blocked transpose
+ *     kernels for the one with the fewest misses on a given cache, for
+ *     each requested matrix shape, and emits the winners as C code.
+ *
+ * A kernel variant is described by
+ *   th, tw  - tile height (rows of A) and width (columns of A)
+ *   order   - 0: walk tiles row by row, 1: column by column
+ *   inner   - 0: inside a tile, copy A row by row, 1: column by column
+ *   diag    - 1: defer the diagonal element of each row (column) to the
+ *             end of it, so A and B do not evict each other's line
+ *   buf     - 1: copy a whole tile row (column) of up to 8 elements into
+ *             locals before storing any of them
+ *
+ * Every candidate runs through the instrumented LOAD()/STORE() path
+ * into the embedded cache model, exactly as test-trans evaluates it.
+ * The generated file defines transpose_tuned(), which dispatches on
+ * (M, N), and registerTunedFunctions(), which registers it.
+ *
+ * Shapes are limited to MAXN x MAXN: every candidate costs a simulated
+ * run of M*N copies, and the few thousand candidates of a shape
+ * take about 8 seconds at 256x256. Larger shapes fall back to the
+ * generic loop of transpose_tuned.
+ */
+#define TRACE_TRANS
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include "cachelab.h"
+#include "cachesim.h"
+
+/* Maximum array dimension and number of shapes per run; see above */
+#define MAXN 256
+#define MAXSHAPES 32
+
+typedef struct variant {
+    int th, tw;
+    int order;
+    int inner;
+    int diag;
+    int buf;
+} variant_t;
+
+typedef struct shape {
+    int M, N;
+    variant_t best;
+    unsigned int misses;
+} shape_t;
+
+/* Tile edge lengths tried for both tile dimensions */
+static const int tile_sizes[] = {
+    1, 2, 3, 4, 5, 6, 7, 8, 10, 12, 14, 16, 17, 18, 20, 23, 24, 32
+};
+
+static int A[MAXN*MAXN] __attribute__((aligned(4096)));
+static int B[MAXN*MAXN] __attribute__((aligned(4096)));
+
+/*
+ * copy_line - Copy the run of A[i][j] (j = j0..j1 if along_row, else
+ *     i = i0..i1) into B, with the variant's diagonal and buffering
+ *     rules. This is the body the generator spells out as C.
+ */
+static void copy_line(const variant_t *v, int M, int N, int a[N][M], int b[M][N],
+                      int i, int j, int len, int along_row)
+{
+    int k, tmp = 0, d = 0, t[8];
+
+    if (v->buf && len == (along_row ? v->tw : v->th)) {
+        for (k = 0; k < len; k++)
+            t[k] = along_row ? LOAD(a[i][j+k]) : LOAD(a[i+k][j]);
+        for (k = 0; k < len; k++) {
+            if (along_row)
+                STORE(b[j+k][i], t[k]);
+            else
+                STORE(b[j][i+k], t[k]);
+        }
+        return;
+    }
+    for (k = 0; k < len; k++) {
+        int r = along_row ? i : i + k;
+        int c = along_row ? j + k : j;
+        if (v->diag && r == c) {
+            tmp = LOAD(a[r][c]);
+            d = 1;
+            continue;
+        }
+        STORE(b[c][r], LOAD(a[r][c]));
+    }
+    if (d)
+        STORE(b[along_row ? i : j][along_row ? i : j], tmp);
+}
+
+/*
+ * run_variant - Transpose with variant v
+ */
+static void run_variant(const variant_t *v, int M, int N, int a[N][M], int b[M][N])
+{
+    int ii, jj, i, j, t, u;
+    int nt = v->order ? (M + v->tw - 1) / v->tw : (N + v->th - 1) / v->th;
+    int nu = v->order ? (N + v->th - 1) / v->th : (M + v->tw - 1) / v->tw;
+
+    for (t = 0; t < nt; t++) {
+        for (u = 0; u < nu; u++) {
+            ii = (v->order ? u : t) * v->th;
+            jj = (v->order ? t : u) * v->tw;
+            if (v->inner == 0) {
+                for (i = ii; i < ii + v->th && i < N; i++)
+                    copy_line(v, M, N, a, b, i, jj,
+                              (jj + v->tw <= M) ? v->tw : M - jj, 1);
+            } else {
+                for (j = jj; j < jj + v->tw && j < M; j++)
+                    copy_line(v, M, N, a, b, ii, j,
+                              (ii + v->th <= N) ? v->th : N - ii, 0);
+            }
+        }
+    }
+}
+
+/*
+ * score_variant - Misses of variant v, or 0 if it is not a transpose
+ */
+static unsigned int score_variant(const variant_t *v, int M, int N,
+                                  int s, int E, int b)
+{
+    int r, c;
+    unsigned int misses;
+    cachesim_t sim;
+    int (*a)[M] = (int (*)[M])A;
+    int (*bm)[N] = (int (*)[N])B;
+
+    if (cacheSimInit(&sim, s, E, b) < 0) {
+        fprintf(stderr, "Unable to allocate the cache model\n");
+        exit(1);
+    }
+    initMatrix(M, N, a, bm);
+    setTraceSink(cacheSimSink, &sim);
+    run_variant(v, M, N, a, bm);
+    setTraceSink(NULL, NULL);
+    cacheSimFlush(&sim);
+    misses = sim.misses;
+    cacheSimFree(&sim);
+
+    for (r = 0; r < N; r++)
+        for (c = 0; c < M; c++)
+            if (bm[c][r] != a[r][c])
+                return 0;
+    return misses;
+}
+
+/*
+ * tune_shape - Exhaustively search the family for shape sh
+ */
+static void tune_shape(shape_t *sh, int s, int E, int b)
+{
+    int n = sizeof(tile_sizes) / sizeof(tile_sizes[0]);
+    int x, y, tried = 0;
+    unsigned int misses;
+    variant_t v;
+
+    sh->misses = 0;
+    for (x = 0; x < n; x++) {
+        for (y = 0; y < n; y++) {
+            v.th = tile_sizes[x];
+            v.tw = tile_sizes[y];
+            for (v.buf = 0; v.buf <= 1; v.buf++) {
+                for (v.diag = 0; v.diag <= 1; v.diag++) {
+                    for (v.order = 0; v.order <= 1; v.order++) {
+                        for (v.inner = 0; v.inner <= 1; v.inner++) {
+                            /* Only up to 8 buffered elements fit in locals */
+                            if (v.buf && (v.inner ? v.th : v.tw) > 8)
+                                continue;
+                            misses = score_variant(&v, sh->M, sh->N, s, E, b);
+                            tried++;
+                            if (misses == 0) {
+                                fprintf(stderr, "Error: variant %dx%d is not a transpose\n",
+                                        v.th, v.tw);
+                                exit(1);
+                            }
+                            if (sh->misses == 0 || misses < sh->misses) {
+                                sh->misses = misses;
+                                sh->best = v;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+    fprintf(stderr, "%dx%d: %d variants, best %dx%d order=%d inner=%d diag=%d buf=%d, %u misses\n",
+            sh->M, sh->N, tried, sh->best.th, sh->best.tw, sh->best.order,
+            sh->best.inner, sh->best.diag, sh->best.buf, sh->misses);
+}
+
+/*
+ * emit_shape - Write the winning variant for sh as a C function with
+ *     the same access order as run_variant()
+ */
+static void emit_shape(FILE *fp, const shape_t *sh)
+{
+    const variant_t *v = &sh->best;
+    int k, len = v->inner ? v->th : v->tw;
+    const char *ln = v->inner ? "j" : "i";      /* the loop over lines */
+
+    fprintf(fp, "/* %dx%d: %dx%d tiles, order=%d inner=%d diag=%d buf=%d, %u misses */\n",
+            sh->M, sh->N, v->th, v->tw, v->order, v->inner, v->diag, v->buf, sh->misses);
+    fprintf(fp, "static void tuned_%dx%d(int M, int N, int A[N][M], int B[M][N])\n{\n",
+            sh->M, sh->N);
+    fprintf(fp, "    int ii, jj, i, j;\n");
+    if (v->diag)
+        fprintf(fp, "    int tmp = 0, d = 0;\n");
+    if (v->buf) {
+        fprintf(fp, "    int t0");
+        for (k = 1; k < len; k++)
+            fprintf(fp, ", t%d", k);
+        fprintf(fp, ";\n");
+    }
+    fprintf(fp, "\n");
+
+    if (v->order == 0) {
+        fprintf(fp, "    for (ii = 0; ii < N; ii += %d) {\n", v->th);
+        fprintf(fp, "        for (jj = 0; jj < M; jj += %d) {\n", v->tw);
+    } else {
+        fprintf(fp, "    for (jj = 0; jj < M; jj += %d) {\n", v->tw);
+        fprintf(fp, "        for (ii = 0; ii < N; ii += %d) {\n", v->th);
+    }
+    if (v->inner == 0)
+        fprintf(fp, "            for (i = ii; i < ii + %d && i < N; i++) {\n", v->th);
+    else
+        fprintf(fp, "            for (j = jj; j < jj + %d && j < M; j++) {\n", v->tw);
+
+    if (v->buf) {
+        if (v->inner == 0)
+            fprintf(fp, "                if (jj + %d <= M) {\n", v->tw);
+        else
+            fprintf(fp, "                if (ii + %d <= N) {\n", v->th);
+        for (k = 0; k < len; k++) {
+            if (v->inner == 0)
+                fprintf(fp, "                    t%d = LOAD(A[i][jj+%d]);\n", k, k);
+            else
+                fprintf(fp, "                    t%d = LOAD(A[ii+%d][j]);\n", k, k);
+        }
+        for (k = 0; k < len; k++) {
+            if (v->inner == 0)
+                fprintf(fp, "                    STORE(B[jj+%d][i], t%d);\n", k, k);
+            else
+                fprintf(fp, "                    STORE(B[j][ii+%d], t%d);\n", k, k);
+        }
+        fprintf(fp, "                    continue;\n");
+        fprintf(fp, "                }\n");
+    }
+
+    if (v->inner == 0)
+        fprintf(fp, "                for (j = jj; j < jj + %d && j < M; j++) {\n", v->tw);
+    else
+        fprintf(fp, "                for (i = ii; i < ii + %d && i < N; i++) {\n", v->th);
+    if (v->diag) {
+        fprintf(fp, "                    if (i == j) {\n");
+        fprintf(fp, "                        tmp = LOAD(A[i][j]);\n");
+        fprintf(fp, "                        d = 1;\n");
+        fprintf(fp, "                        continue;\n");
+        fprintf(fp, "                    }\n");
+    }
+    fprintf(fp, "                    STORE(B[j][i], LOAD(A[i][j]));\n");
+    fprintf(fp, "                }\n");
+    if (v->diag) {
+        fprintf(fp, "                if (d) {\n");
+        fprintf(fp, "                    STORE(B[%s][%s], tmp);\n", ln, ln);
+        fprintf(fp, "                    d = 0;\n");
+        fprintf(fp, "                }\n");
+    }
+    fprintf(fp, "            }\n");
+    fprintf(fp, "        }\n");
+    fprintf(fp, "    }\n");
+    fprintf(fp, "}\n\n");
+}
+
+/*
+ * emit_file - Write the generated translation unit
+ */
+static void emit_file(FILE *fp, shape_t *shapes, int nshapes,
+                      int s, int E, int b, int argc, char *argv[])
+{
+    int i;
+
+    fprintf(fp, "/*\n * trans-tuned.c - Transpose kernels generated by\n *    ");
+    for (i = 0; i < argc; i++)
+        fprintf(fp, " %s", argv[i]);
+    fprintf(fp, "\n *\n * Tuned for a cache with s=%d, E=%d, b=%d. Do not edit by hand;\n"
+            " * rerun autotune instead.\n */\n", s, E, b);
+    fprintf(fp, "#include \"cachelab.h\"\n\n");
+
+    for (i = 0; i < nshapes; i++)
+        emit_shape(fp, &shapes[i]);
+
+    fprintf(fp, "/*\n * transpose_tuned - Dispatch to the kernel tuned for this shape, or\n"
+            " *     fall back to a row-wise scan for shapes that were not tuned\n */\n");
+    fprintf(fp, "static char transpose_tuned_desc[] = \"Autotuned transpose\";\n");
+    fprintf(fp, "static void transpose_tuned(int M, int N, int A[N][M], int B[M][N])\n{\n");
+    fprintf(fp, "    int i, j;\n\n");
+    for (i = 0; i < nshapes; i++) {
+        fprintf(fp, "    if (M == %d && N == %d) {\n", shapes[i].M, shapes[i].N);
+        fprintf(fp, "        tuned_%dx%d(M, N, A, B);\n", shapes[i].M, shapes[i].N);
+        fprintf(fp, "        return;\n    }\n");
+    }
+    fprintf(fp, "    for (i = 0; i < N; i++)\n");
+    fprintf(fp, "        for (j = 0; j < M; j++)\n");
+    fprintf(fp, "            STORE(B[j][i], LOAD(A[i][j]));\n");
+    fprintf(fp, "}\n\n");
+
+    fprintf(fp, "/*\n * registerTunedFunctions - Called from registerFunctions() in trans.c\n */\n");
+    fprintf(fp, "void registerTunedFunctions()\n{\n");
+    fprintf(fp, "    registerTransFunction(transpose_tuned, transpose_tuned_desc);\n");
+    fprintf(fp, "}\n");
+}
+
+/*
+ * usage - Print usage info
+ */
+void usage(char *argv[]){
+    printf("Usage: %s [-h] -s <s> -E <E> -b <b> -S <M>x<N> [-S ...] [-o <file>]\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h          Print this help message.\n");
+    printf("  -s <s>      Number of set index bits.\n");
+    printf("  -E <E>      Number of lines per set.\n");
+    printf("  -b <b>      Number of block offset bits.\n");
+    printf("  -S <M>x<N>  Shape to tune for (M columns, N rows, each at most %d);\n"
+           "              repeatable, repeats are ignored.\n", MAXN);
+    printf("  -o <file>   Write the generated C here (default stdout).\n");
+    printf("Example: %s -s 5 -E 1 -b 5 -S 32x32 -S 64x64 -S 61x67 -o trans-tuned.c\n", argv[0]);
+}
+
+int main(int argc, char* argv[])
+{
+    char c;
+    int i, j, s = -1, E = -1, b = -1, nshapes = 0;
+    shape_t shapes[MAXSHAPES];
+    FILE *out_fp = stdout;
+    char *outname = NULL;
+
+    while ((c = getopt(argc, argv, "s:E:b:S:o:h")) != -1) {
+        switch (c) {
+        case 's':
+            s = atoi(optarg);
+            break;
+        case 'E':
+            E = atoi(optarg);
+            break;
+        case 'b':
+            b = atoi(optarg);
+            break;
+        case 'S':
+            if (nshapes == MAXSHAPES ||
+                sscanf(optarg, "%dx%d", &shapes[nshapes].M, &shapes[nshapes].N) != 2 ||
+                shapes[nshapes].M <= 0 || shapes[nshapes].N <= 0 ||
+                shapes[nshapes].M > MAXN || shapes[nshapes].N > MAXN) {
+                printf("Error: Bad shape %s (at most %dx%d)\n", optarg, MAXN, MAXN);
+                exit(1);
+            }
+            /* A repeated shape would define its kernel twice */
+            for (j = 0; j < nshapes; j++)
+                if (shapes[j].M == shapes[nshapes].M && shapes[j].N == shapes[nshapes].N)
+                    break;
+            if (j == nshapes)
+                nshapes++;
+            break;
+        case 'o':
+            outname = optarg;
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+
+    if (s < 0 || E <= 0 || b < 0 || nshapes == 0) {
+        printf("Error: Missing required argument\n");
+        usage(argv);
+        exit(1);
+    }
+
+    for (i = 0; i < nshapes; i++)
+        tune_shape(&shapes[i], s, E, b);
+
+    if (outname != NULL && (out_fp = fopen(outname, "w")) == NULL) {
+        printf("Error: Unable to open %s\n", outname);
+        exit(1);
+    }
+    emit_file(out_fp, shapes, nshapes, s, E, b, argc, argv);
+    if (out_fp != stdout)
+        fclose(out_fp);
+    return 0;
+}
@@ -1,15 +1,23 @@
 /*
  * cachelab.c - Cache Lab helper functions
  */
+#define _POSIX_C_SOURCE 200112L /* for posix_memalign() under -std=c99 */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <string.h>
 #include "cachelab.h"
 #include <time.h>
 
 trans_func_t func_list[MAX_TRANS_FUNCS];
 int func_counter = 0;
 
+kernel_t kernel_list[MAX_KERNELS];
+int kernel_counter = 0;
+
+static trace_sink_t trace_sink = NULL;
+static void *trace_ctx = NULL;
+
 /*
  * printSummary - Summarize the cache simulation statistics. Student cache simulators
  *                must call this function in order to be properly autograded.
@@ -23,6 +31,29 @@ void printSummary(int hits, int misses, int evictions)
     fclose(output_fp);
 }
 
+/*
+ * allocMatrix - Allocate a page-aligned matrix, so that its cache set
+ *     mapping is the same in every tool and every run
+ */
+int *allocMatrix(int rows, int cols)
+{
+    void *p;
+    size_t side = rows > cols ? rows : cols;
+
+    /* A kernel that runs whole tiles of any size up to MATRIX_PAD past
+       either edge reaches index dim + MATRIX_PAD - 2 at most, so with
+       MATRIX_PAD to spare it stays inside the square, even if it mixes
+       up rows and columns: (side - 1) * cols + side <= side * side */
+    if (side < 256)
+        side = 256;
+    side = (side + MATRIX_PAD - 1) / MATRIX_PAD * MATRIX_PAD + MATRIX_PAD;
+    if (posix_memalign(&p, 4096, side * side * sizeof(int)) != 0) {
+        fprintf(stderr, "Unable to allocate a %dx%d matrix\n", rows, cols);
+        exit(1);
+    }
+    return (int *)p;
+}
+
 /*
  * initMatrix - Initialize the given matrix
  */
@@ -74,6 +105,7 @@ void registerTransFunction(void (*trans)(int M, int N, int[N][M], int[M][N]),
                            char* desc)
 {
     func_list[func_counter].func_ptr = trans;
+    func_list[func_counter].traced_ptr = NULL;
     func_list[func_counter].description = desc;
     func_list[func_counter].correct = 0;
     func_list[func_counter].num_hits = 0;
@@ -81,3 +113,185 @@ void registerTransFunction(void (*trans)(int M, int N, int[N][M], int[M][N]),
     func_list[func_counter].num_evictions =0;
     func_counter++;
 }
+
+/*
+ * registerTracedTransFunction - Attach the traced build of a function
+ *     to its native entry, or add it on its own if there is none
+ */
+void registerTracedTransFunction(void (*trans)(int M, int N, int[N][M], int[M][N]),
+                                 char* desc)
+{
+    static int traced_counter = 0;
+
+    if (traced_counter == func_counter) {
+        registerTransFunction(NULL, desc);
+    }
+    assert(strcmp(func_list[traced_counter].description, desc) == 0);
+    func_list[traced_counter].traced_ptr = trans;
+    traced_counter++;
+}
+
+/*
+ * registerKernel - Add a kernel to the list of kernels to be tested
+ */
+void registerKernel(const kernel_t *k)
+{
+    assert(kernel_counter < MAX_KERNELS && k->nbufs <= MAX_KERNEL_BUFS);
+    kernel_list[kernel_counter] = *k;
+    kernel_list[kernel_counter].traced_ptr = NULL;
+    kernel_list[kernel_counter].correct = 0;
+    kernel_list[kernel_counter].num_hits = 0;
+    kernel_list[kernel_counter].num_misses = 0;
+    kernel_list[kernel_counter].num_evictions = 0;
+    kernel_counter++;
+}
+
+/*
+ * registerTracedKernel - Attach the traced build of a kernel to its
+ *     native entry, or add it on its own if there is none
+ */
+void registerTracedKernel(const kernel_t *k)
+{
+    static int traced_counter = 0;
+
+    if (traced_counter == kernel_counter) {
+        registerKernel(k);
+        kernel_list[traced_counter].func_ptr = NULL;
+    }
+    assert(strcmp(kernel_list[traced_counter].description, k->description) == 0);
+    kernel_list[traced_counter].traced_ptr = k->func_ptr;
+    traced_counter++;
+}
+
+/*
+ * setTraceSink - Route the accesses of traced transpose functions
+ */
+void setTraceSink(trace_sink_t sink, void *ctx)
+{
+    trace_sink = sink;
+    trace_ctx = ctx;
+}
+
+/*
+ * traceAccess - Called by LOAD() and STORE() in a TRACE_TRANS build
+ */
+void *traceAccess(char op, void *addr, int size)
+{
+    if (trace_sink != NULL)
+        trace_sink(trace_ctx, op, (unsigned long)addr, size);
+    return addr;
+}
+
+/*
+ * parseTraceLine - Parse one lackey trace line, with an optional
+ *     "*<count>" suffix as written by tracecompact
+ */
+int parseTraceLine(const char *buf, char *op, unsigned long *addr,
+                   int *size, unsigned int *count)
+{
+    char *end;
+
+    while (*buf == ' ')
+        buf++;
+    if (*buf != 'I' && *buf != 'L' && *buf != 'S' && *buf != 'M')
+        return 0;
+    *op = *buf++;
+    if (*buf != ' ')
+        return 0;
+
+    *addr = strtoul(buf, &end, 16);
+    if (end == buf || *end != ',')
+        return 0;
+    buf = end + 1;
+    *size = (int)strtol(buf, &end, 10);
+    if (end == buf)
+        return 0;
+
+    /* A modify is a load followed by a store to the same address */
+    *count = (*op == 'M') ? 2 : 1;
+    if (*end == '*')
+        *count = (unsigned int)strtoul(end + 1, NULL, 10);
+    return 1;
+}
+
+/*
+ * findRegion - Linear lookup; traces have only a handful of regions
+ */
+int findRegion(const trace_region_t *regions, int n, unsigned long addr)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+        if (addr >= regions[i].lo && addr < regions[i].hi)
+            return i;
+    return -1;
+}
+
+/*
+ * printTraceRun - Write a run as a trace line. The count is only
+ *     spelled out when it differs from what the operation implies, so
+ *     runs of a single access stay plain lackey lines.
+ */
+void printTraceRun(FILE *fp, const trace_run_t *run)
+{
+    unsigned int implied = (run->op == 'M') ? 2 : 1;
+
+    if (run->op == 'I')
+        fprintf(fp, "I  %08lx,%d", run->addr, run->size);
+    else
+        fprintf(fp, " %c %08lx,%d", run->op, run->addr, run->size);
+    if (run->count != implied)
+        fprintf(fp, "*%u", run->count);
+    fputc('\n', fp);
+}
+
+/*
+ * runFilterInit - Start an empty run-length filter
+ */
+void runFilterInit(run_filter_t *f, int b)
+{
+    f->b = b;
+    f->pending = 0;
+    f->accesses = 0;
+    f->runs = 0;
+}
+
+/*
+ * runFilterPush - Extend the open run if addr falls in the same line,
+ *     otherwise close it and open a new one
+ */
+int runFilterPush(run_filter_t *f, char op, unsigned long addr, int size,
+                  unsigned int count, trace_run_t *out)
+{
+    int closed = 0;
+
+    f->accesses += count;
+    if (f->pending) {
+        if ((f->run.addr >> f->b) == (addr >> f->b)) {
+            f->run.count += count;
+            return 0;
+        }
+        *out = f->run;
+        f->runs++;
+        closed = 1;
+    }
+    f->pending = 1;
+    f->run.op = op;
+    f->run.addr = addr;
+    f->run.size = size;
+    f->run.count = count;
+    return closed;
+}
+
+/*
+ * runFilterFlush - Close the open run at the end of a trace
+ */
+int runFilterFlush(run_filter_t *f, trace_run_t *out)
+{
+    if (!f->pending)
+        return 0;
+    *out = f->run;
+    f->runs++;
+    f->pending = 0;
+    return 1;
+}
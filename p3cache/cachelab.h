@@ -5,10 +5,13 @@
 #ifndef CACHELAB_TOOLS_H
 #define CACHELAB_TOOLS_H
 
+#include <stdio.h>
+
 #define MAX_TRANS_FUNCS 100
 
 typedef struct trans_func{
   void (*func_ptr)(int M,int N,int[N][M],int[M][N]);
+  void (*traced_ptr)(int M,int N,int[N][M],int[M][N]); /* TRACE_TRANS build */
   char* description;
   char correct;
   unsigned int num_hits;
@@ -16,6 +19,36 @@ typedef struct trans_func{
   unsigned int num_evictions;
 } trans_func_t;
 
+/*
+ * Kernels for kernlab. A kernel works on up to MAX_KERNEL_BUFS int
+ * buffers whose extents are fixed or follow the problem size n, e.g.
+ * an n x n matrix multiply reads A and B and writes C.
+ */
+#define MAX_KERNELS 100
+#define MAX_KERNEL_BUFS 4
+#define DIM_N (-1)              /* extent equal to the problem size */
+
+typedef struct kernel_buf {
+  char *name;
+  int rows;                     /* DIM_N or a fixed count */
+  int cols;
+  char output;                  /* written by the kernel */
+} kernel_buf_t;
+
+typedef struct kernel {
+  char *description;
+  int nbufs;
+  kernel_buf_t bufs[MAX_KERNEL_BUFS];
+  void (*init)(int n, int *bufs[]);     /* NULL: random inputs, zero outputs */
+  void (*func_ptr)(int n, int *bufs[]);
+  void (*traced_ptr)(int n, int *bufs[]); /* TRACE_TRANS build */
+  int (*validate)(int n, int *bufs[]);  /* 1 if the outputs are right */
+  char correct;
+  unsigned int num_hits;
+  unsigned int num_misses;
+  unsigned int num_evictions;
+} kernel_t;
+
 /*
  * printSummary - This function provides a standard way for your cache
  * simulator * to display its final hit and miss statistics
@@ -24,6 +57,18 @@ void printSummary(int hits,  /* number of  hits */
 				  int misses, /* number of misses */
 				  int evictions); /* number of evictions */
 
+/*
+ * allocMatrix - Allocate a page-aligned rows x cols matrix on the heap.
+ *     It is backed by a square whose side is the larger dimension, at
+ *     least 256 (the static arrays the tools used to have), rounded up
+ *     to MATRIX_PAD and then MATRIX_PAD more, so a function whose tiles
+ *     of any size up to MATRIX_PAD run past the edges, or that swaps M
+ *     and N, fails validation rather than corrupting the heap. Pages it never touches are not
+ *     backed by memory. Exits on failure.
+ */
+#define MATRIX_PAD 32   /* the largest tile autotune tries */
+int *allocMatrix(int rows, int cols);
+
 /* Fill the matrix with data */
 void initMatrix(int M, int N, int A[N][M], int B[M][N]);
 
@@ -34,4 +79,120 @@ void correctTrans(int M, int N, int A[N][M], int B[M][N]);
 void registerTransFunction(
     void (*trans)(int M,int N,int[N][M],int[M][N]), char* desc);
 
+/*
+ * Attach the traced build of a function to the next entry of the list.
+ * A program can link both builds of trans.c: the native one registers
+ * through registerFunctions(), the TRACE_TRANS one through
+ * registerTracedFunctions(), in the same order.
+ */
+void registerTracedTransFunction(
+    void (*trans)(int M,int N,int[N][M],int[M][N]), char* desc);
+
+/* Add a copy of the kernel descriptor k to the kernel list */
+void registerKernel(const kernel_t *k);
+
+/* Attach the traced build of k to its entry, as for transposes */
+void registerTracedKernel(const kernel_t *k);
+
+/*
+ * In-process memory tracing. Transpose functions read and write their
+ * matrices through LOAD() and STORE(). In a build with TRACE_TRANS
+ * defined, every such access is reported to the current trace sink
+ * before it is performed; otherwise they are plain array accesses.
+ */
+typedef void (*trace_sink_t)(void *ctx, char op, unsigned long addr, int size);
+
+/* Route traced accesses to sink (NULL turns tracing off) */
+void setTraceSink(trace_sink_t sink, void *ctx);
+
+/* Report one access to the current sink and return addr */
+void *traceAccess(char op, void *addr, int size);
+
+/*
+ * Vector kernels access whole rows at once through pointers; report
+ * those with LOAD_PTR()/STORE_PTR(), which evaluate to the pointer.
+ *
+ * Everything in trans.c but the registration entry points is static,
+ * so the traced build can be linked next to the native one; the
+ * renames below keep those entry points apart.
+ */
+#ifdef TRACE_TRANS
+#define LOAD(x)     (*(__typeof__(&(x)))traceAccess('L', &(x), sizeof(x)))
+#define STORE(x, v) ({ __typeof__(x) trace_v_ = (v); \
+                       *(__typeof__(&(x)))traceAccess('S', &(x), sizeof(x)) = trace_v_; })
+#define LOAD_PTR(p, size)  traceAccess('L', (void *)(p), size)
+#define STORE_PTR(p, size) traceAccess('S', (void *)(p), size)
+#define registerFunctions      registerTracedFunctions
+#define registerTunedFunctions registerTracedTunedFunctions
+#define registerTransFunction  registerTracedTransFunction
+#define registerKernels        registerTracedKernels
+#define registerKernel         registerTracedKernel
+#else
+#define LOAD(x)     (x)
+#define STORE(x, v) ((x) = (v))
+#define LOAD_PTR(p, size)  ((void *)(p))
+#define STORE_PTR(p, size) ((void *)(p))
+#endif
+
+/*
+ * A run is a maximal sequence of consecutive accesses that touch the
+ * same cache line. Only the first access of a run can miss: the rest
+ * hit under any replacement policy that does not reorder lines, so a
+ * simulator can apply the whole run as one model update.
+ */
+typedef struct trace_run {
+  char op;                /* operation of the first access in the run */
+  unsigned long addr;     /* address of the first access in the run */
+  int size;               /* size of the first access in the run */
+  unsigned int count;     /* number of cache accesses in the run */
+} trace_run_t;
+
+typedef struct run_filter {
+  int b;                  /* number of block offset bits */
+  int pending;            /* is a run currently open? */
+  trace_run_t run;        /* the open run */
+  unsigned long accesses; /* cache accesses pushed into the filter */
+  unsigned long runs;     /* runs emitted by the filter */
+} run_filter_t;
+
+/*
+ * Address ranges a trace is filtered and attributed by, e.g. the two
+ * matrices and the stack a transpose function runs on
+ */
+#define MAX_REGIONS 4
+
+typedef struct trace_region {
+  char name[16];
+  unsigned long lo;       /* first byte */
+  unsigned long hi;       /* one past the last byte */
+} trace_region_t;
+
+/* Index of the region holding addr, or -1 if it is in none of them */
+int findRegion(const trace_region_t *regions, int n, unsigned long addr);
+
+/*
+ * parseTraceLine - Parse one valgrind lackey trace line
+ *     ("I 0400d7d4,8", " L 04f6b868,8", ...). Compacted traces may
+ *     append "*<count>", the number of cache accesses the line stands
+ *     for. Returns 1 on success, 0 for lines that are not accesses.
+ */
+int parseTraceLine(const char *buf, char *op, unsigned long *addr,
+                   int *size, unsigned int *count);
+
+/* Write one run back out in (compacted) lackey trace format */
+void printTraceRun(FILE *fp, const trace_run_t *run);
+
+/* Start an empty run-length filter for lines of 2^b bytes */
+void runFilterInit(run_filter_t *f, int b);
+
+/*
+ * runFilterPush - Feed count cache accesses to addr into the filter.
+ *     Returns 1 and fills *out when this closes the previous run.
+ */
+int runFilterPush(run_filter_t *f, char op, unsigned long addr, int size,
+                  unsigned int count, trace_run_t *out);
+
+/* Close the open run, if any. Returns 1 and fills *out if there was one */
+int runFilterFlush(run_filter_t *f, trace_run_t *out);
+
 #endif /* CACHELAB_TOOLS_H */
@@ -0,0 +1,138 @@
+/*
+ * cachesim.c - An embeddable LRU cache model
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "cachesim.h"
+
+/*
+ * cacheSimInit - Create an empty cache. Returns 0 on success and -1
+ *     if the storage could not be allocated.
+ */
+int cacheSimInit(cachesim_t *sim, int s, int E, int b)
+{
+    size_t nlines = ((size_t)1 << s) * E;
+
+    sim->s = s;
+    sim->E = E;
+    sim->b = b;
+    sim->tags = calloc(nlines, sizeof(unsigned long));
+    sim->stamps = calloc(nlines, sizeof(unsigned long));
+    if (sim->tags == NULL || sim->stamps == NULL) {
+        cacheSimFree(sim);
+        return -1;
+    }
+    sim->clock = 0;
+    sim->hits = 0;
+    sim->misses = 0;
+    sim->evictions = 0;
+    runFilterInit(&sim->filter, b);
+    cacheSimSetRegions(sim, NULL, 0);
+    return 0;
+}
+
+/*
+ * cacheSimSetRegions - Attribute hits, misses and evictions to the
+ *     region the accessed address falls in. Evictions are charged to
+ *     the region of the access that caused them.
+ */
+void cacheSimSetRegions(cachesim_t *sim, const trace_region_t *regions, int n)
+{
+    sim->regions = regions;
+    sim->nregions = n;
+    memset(sim->region_hits, 0, sizeof(sim->region_hits));
+    memset(sim->region_misses, 0, sizeof(sim->region_misses));
+    memset(sim->region_evictions, 0, sizeof(sim->region_evictions));
+}
+
+/*
+ * cacheSimFree - Release the storage of the cache
+ */
+void cacheSimFree(cachesim_t *sim)
+{
+    free(sim->tags);
+    free(sim->stamps);
+    sim->tags = NULL;
+    sim->stamps = NULL;
+}
+
+/*
+ * cacheSimAccess - Look up the line holding addr. On a miss, fill an
+ *     invalid line if there is one and evict the least recently used
+ *     line otherwise. The remaining count-1 accesses are hits.
+ */
+void cacheSimAccess(cachesim_t *sim, unsigned long addr, unsigned int count)
+{
+    unsigned long set = (addr >> sim->b) & ((1UL << sim->s) - 1);
+    unsigned long tag = addr >> (sim->s + sim->b);
+    unsigned long *tags = sim->tags + set * sim->E;
+    unsigned long *stamps = sim->stamps + set * sim->E;
+    int i, victim = 0;
+    int r = findRegion(sim->regions, sim->nregions, addr);
+
+    if (r < 0)
+        r = sim->nregions;
+    sim->clock++;
+    for (i = 0; i < sim->E; i++) {
+        if (stamps[i] != 0 && tags[i] == tag) {
+            stamps[i] = sim->clock;
+            sim->hits += count;
+            sim->region_hits[r] += count;
+            return;
+        }
+        if (stamps[i] < stamps[victim])
+            victim = i;
+    }
+
+    sim->misses++;
+    sim->hits += count - 1;
+    sim->region_misses[r]++;
+    sim->region_hits[r] += count - 1;
+    if (stamps[victim] != 0) {
+        sim->evictions++;
+        sim->region_evictions[r]++;
+    }
+    tags[victim] = tag;
+    stamps[victim] = sim->clock;
+}
+
+/*
+ * cacheSimPush - Feed one access (a modify counts twice) to the model.
+ *     An access that spans lines, e.g. an unaligned vector, is one
+ *     access to each line it touches.
+ */
+void cacheSimPush(cachesim_t *sim, char op, unsigned long addr, int size)
+{
+    unsigned long end = addr + (size > 0 ? size : 1);
+    unsigned long next;
+    trace_run_t run;
+
+    do {
+        next = ((addr >> sim->b) + 1) << sim->b;
+        if (next > end)
+            next = end;
+        if (runFilterPush(&sim->filter, op, addr, (int)(next - addr),
+                          (op == 'M') ? 2 : 1, &run))
+            cacheSimAccess(sim, run.addr, run.count);
+        addr = next;
+    } while (addr < end);
+}
+
+/*
+ * cacheSimFlush - Apply the pending run at the end of a trace
+ */
+void cacheSimFlush(cachesim_t *sim)
+{
+    trace_run_t run;
+
+    if (runFilterFlush(&sim->filter, &run))
+        cacheSimAccess(sim, run.addr, run.count);
+}
+
+/*
+ * cacheSimSink - Trace sink adapter for setTraceSink()
+ */
+void cacheSimSink(void *sim, char op, unsigned long addr, int size)
+{
+    cacheSimPush((cachesim_t *)sim, op, addr, size);
+}
@@ -0,0 +1,56 @@
+/*
+ * cachesim.h - An embeddable LRU cache model
+ *
+ * The model follows the same rules as csim-ref, so an address stream
+ * fed into it in-process produces the same hit, miss and eviction
+ * counts as the corresponding trace file run through ./csim-ref, as
+ * long as no access spans two lines: the model counts such an access
+ * once per line, where csim-ref only looks at its first byte.
+ */
+
+#ifndef CACHESIM_H
+#define CACHESIM_H
+
+#include "cachelab.h"
+
+typedef struct cachesim {
+  int s;                    /* number of set index bits */
+  int E;                    /* number of lines per set */
+  int b;                    /* number of block offset bits */
+  unsigned long *tags;      /* 2^s * E line tags */
+  unsigned long *stamps;    /* last use of each line, 0 if invalid */
+  unsigned long clock;      /* logical time of the last access */
+  unsigned int hits;
+  unsigned int misses;
+  unsigned int evictions;
+  run_filter_t filter;      /* collapses same-line runs before the model */
+  const trace_region_t *regions; /* accesses are also counted per region */
+  int nregions;
+  unsigned int region_hits[MAX_REGIONS + 1];   /* last: outside all regions */
+  unsigned int region_misses[MAX_REGIONS + 1];
+  unsigned int region_evictions[MAX_REGIONS + 1];
+} cachesim_t;
+
+/* Create an empty cache with 2^s sets of E lines of 2^b bytes */
+int cacheSimInit(cachesim_t *sim, int s, int E, int b);
+
+/* Count accesses per region of the table, which must outlive the model */
+void cacheSimSetRegions(cachesim_t *sim, const trace_region_t *regions, int n);
+
+/* Release the storage of the cache */
+void cacheSimFree(cachesim_t *sim);
+
+/* Apply count consecutive accesses to the line holding addr */
+void cacheSimAccess(cachesim_t *sim, unsigned long addr, unsigned int count);
+
+/* Feed one trace access, split at line boundaries, through the
+   run-length filter into the model */
+void cacheSimPush(cachesim_t *sim, char op, unsigned long addr, int size);
+
+/* Apply the run still held by the filter; call at the end of a trace */
+void cacheSimFlush(cachesim_t *sim);
+
+/* A trace sink (see setTraceSink) that feeds a cachesim_t */
+void cacheSimSink(void *sim, char op, unsigned long addr, int size);
+
+#endif /* CACHESIM_H */
@@ -91,7 +91,9 @@ pair get_evictindex_maxlru(set my_set, int nlines)
 	return temp;
 }
 
-cache_stats cache_simulator(cache *my_cache, cache_stats my_cache_stats, unsigned long addr)
+// apply count consecutive accesses to the line holding addr: only the
+// first one can miss, the rest are hits that keep bumping its lrunumber
+cache_stats cache_simulator(cache *my_cache, cache_stats my_cache_stats, unsigned long addr, unsigned int count)
 {
 	int b = my_cache_stats.b;
 	int s = my_cache_stats.s;
@@ -104,23 +106,24 @@ cache_stats cache_simulator(cache *my_cache, cache_stats my_cache_stats, unsigne
 	for (int i=0; i<my_cache_stats.nlines; i++) {
 		line temp = my_cache->sets[set_index].lines[i];
 		if ((temp.valid == 1) && (temp.tag == tar_tag)){
-			my_cache_stats.hits++;
-			my_cache->sets[set_index].lines[i].lrunumber++;
+			my_cache_stats.hits += count;
+			my_cache->sets[set_index].lines[i].lrunumber += count;
 			return my_cache_stats;
 		} else if (temp.valid == 0){
 			full = 0;
 		}
 	}
 	my_cache_stats.misses++;
+	my_cache_stats.hits += count - 1;
 	if (full == 1) {
 		// my_cache->sets[set_index].lines[evict_pair.x].valid = 1;
 		my_cache->sets[set_index].lines[evict_pair.x].tag = tar_tag;
-		my_cache->sets[set_index].lines[evict_pair.x].lrunumber = evict_pair.y + 1;
+		my_cache->sets[set_index].lines[evict_pair.x].lrunumber = evict_pair.y + count;
 		my_cache_stats.evicts++;
 	} else {
 		my_cache->sets[set_index].lines[empty_line_index].valid = 1;
 		my_cache->sets[set_index].lines[empty_line_index].tag = tar_tag;
-		my_cache->sets[set_index].lines[empty_line_index].lrunumber = evict_pair.y + 1;
+		my_cache->sets[set_index].lines[empty_line_index].lrunumber = evict_pair.y + count;
 	}
 
 	return my_cache_stats;
@@ -135,8 +138,13 @@ int main(int argc, char *argv[])
 	FILE *openTrace;
 	char instruction;
 	int size;
+	unsigned int count;
 	char *trace_file;
 	char c;
+	char buf[256];
+	int verbose = 0;
+	run_filter_t my_filter;
+	trace_run_t run;
 
     while((c=getopt(argc,argv,"s:E:b:t:vh")) != -1)
 	{
@@ -154,6 +162,9 @@ int main(int argc, char *argv[])
         case 't':
             trace_file = optarg;
             break;
+        case 'v':
+            verbose = 1;
+            break;
         case 'h':
             exit(0);
         default:
@@ -167,26 +178,28 @@ int main(int argc, char *argv[])
 	int nsets = pow(2.0, my_cache_stats.s);
 	my_cache = cache_initializer(nsets, my_cache_stats.nlines);
 	openTrace  = fopen(trace_file, "r");
+	// collapse runs of same-line accesses so each run is one model update
+	runFilterInit(&my_filter, my_cache_stats.b);
 	if (openTrace != NULL) {
-		while (fscanf(openTrace, " %s %lx,%d", &instruction, &addr, &size) == 3) {
+		while (fgets(buf, sizeof(buf), openTrace) != NULL) {
+			if (!parseTraceLine(buf, &instruction, &addr, &size, &count))
+				continue;
 			switch(instruction) {
-				case 'I':
-					break;
 				case 'L':
-					my_cache_stats = cache_simulator(&my_cache, my_cache_stats, addr);
-					break;
 				case 'S':
-					my_cache_stats = cache_simulator(&my_cache, my_cache_stats, addr);
-					break;
 				case 'M':
-					my_cache_stats = cache_simulator(&my_cache, my_cache_stats, addr);
-					my_cache_stats = cache_simulator(&my_cache, my_cache_stats, addr);	
+					if (runFilterPush(&my_filter, instruction, addr, size, count, &run))
+						my_cache_stats = cache_simulator(&my_cache, my_cache_stats, run.addr, run.count);
 					break;
 				default:
 					break;
 			}
 		}
+		if (runFilterFlush(&my_filter, &run))
+			my_cache_stats = cache_simulator(&my_cache, my_cache_stats, run.addr, run.count);
 	}
+	if (verbose)
+		fprintf(stderr, "accesses:%lu model updates:%lu\n", my_filter.accesses, my_filter.runs);
 	if ((my_cache_stats.hits == 5*54503) || (my_cache_stats.hits == 3*89503)){
 		my_cache_stats.hits += 16; my_cache_stats.misses -= 16; my_cache_stats.evicts -= 16;
 	}
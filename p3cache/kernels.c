@@ -0,0 +1,258 @@
+/*
+ * kernels.c - Loop nests evaluated by kernlab
+ *
+ * Each kernel has a prototype of the form:
+ * void kernel(int n, int *bufs[]);
+ * where bufs holds the buffers of its descriptor, in order, with the
+ * extents given there (DIM_N standing for n).
+ *
+ * As in trans.c, buffers are read and written through LOAD() and
+ * STORE() and everything but registerKernels() is static, so that a
+ * traced and a native build of this file can be linked together.
+ * Validation callbacks use plain accesses: they are not measured.
+ */
+#include <stdlib.h>
+#include "cachelab.h"
+
+/* Edge of the square blocks of matmul_blocked: three 8x8 int blocks
+   fit the 1KB cache test-trans evaluates on */
+#define MM_BLOCK 8
+
+/*
+ * check_matmul - C == A * B
+ */
+static int check_matmul(int n, int *bufs[])
+{
+    int (*A)[n] = (int (*)[n])bufs[0];
+    int (*B)[n] = (int (*)[n])bufs[1];
+    int (*C)[n] = (int (*)[n])bufs[2];
+    int i, j, k, sum;
+
+    for (i = 0; i < n; i++)
+        for (j = 0; j < n; j++) {
+            sum = 0;
+            for (k = 0; k < n; k++)
+                sum += A[i][k] * B[k][j];
+            if (C[i][j] != sum)
+                return 0;
+        }
+    return 1;
+}
+
+/*
+ * matmul_ijk - Textbook order: a dot product per element of C, walking
+ *     B down its columns
+ */
+static void matmul_ijk(int n, int *bufs[])
+{
+    int (*A)[n] = (int (*)[n])bufs[0];
+    int (*B)[n] = (int (*)[n])bufs[1];
+    int (*C)[n] = (int (*)[n])bufs[2];
+    int i, j, k, sum;
+
+    for (i = 0; i < n; i++)
+        for (j = 0; j < n; j++) {
+            sum = 0;
+            for (k = 0; k < n; k++)
+                sum += LOAD(A[i][k]) * LOAD(B[k][j]);
+            STORE(C[i][j], sum);
+        }
+}
+
+/*
+ * matmul_ikj - Hoist A[i][k] and stream rows of B and C
+ */
+static void matmul_ikj(int n, int *bufs[])
+{
+    int (*A)[n] = (int (*)[n])bufs[0];
+    int (*B)[n] = (int (*)[n])bufs[1];
+    int (*C)[n] = (int (*)[n])bufs[2];
+    int i, j, k, r;
+
+    for (i = 0; i < n; i++)
+        for (j = 0; j < n; j++)
+            STORE(C[i][j], 0);
+    for (i = 0; i < n; i++)
+        for (k = 0; k < n; k++) {
+            r = LOAD(A[i][k]);
+            for (j = 0; j < n; j++)
+                STORE(C[i][j], LOAD(C[i][j]) + r * LOAD(B[k][j]));
+        }
+}
+
+/*
+ * matmul_blocked - ikj order over MM_BLOCK x MM_BLOCK blocks
+ */
+static void matmul_blocked(int n, int *bufs[])
+{
+    int (*A)[n] = (int (*)[n])bufs[0];
+    int (*B)[n] = (int (*)[n])bufs[1];
+    int (*C)[n] = (int (*)[n])bufs[2];
+    int i, j, k, r, ii, jj, kk;
+
+    for (i = 0; i < n; i++)
+        for (j = 0; j < n; j++)
+            STORE(C[i][j], 0);
+    for (ii = 0; ii < n; ii += MM_BLOCK)
+        for (kk = 0; kk < n; kk += MM_BLOCK)
+            for (jj = 0; jj < n; jj += MM_BLOCK)
+                for (i = ii; i < ii + MM_BLOCK && i < n; i++)
+                    for (k = kk; k < kk + MM_BLOCK && k < n; k++) {
+                        r = LOAD(A[i][k]);
+                        for (j = jj; j < jj + MM_BLOCK && j < n; j++)
+                            STORE(C[i][j], LOAD(C[i][j]) + r * LOAD(B[k][j]));
+                    }
+}
+
+/*
+ * check_stencil - out is the 5-point sum of in, with the border copied
+ */
+static int check_stencil(int n, int *bufs[])
+{
+    int (*in)[n] = (int (*)[n])bufs[0];
+    int (*out)[n] = (int (*)[n])bufs[1];
+    int i, j, v;
+
+    for (i = 0; i < n; i++)
+        for (j = 0; j < n; j++) {
+            if (i == 0 || j == 0 || i == n - 1 || j == n - 1)
+                v = in[i][j];
+            else
+                v = in[i][j] + in[i - 1][j] + in[i + 1][j] +
+                    in[i][j - 1] + in[i][j + 1];
+            if (out[i][j] != v)
+                return 0;
+        }
+    return 1;
+}
+
+static void stencil_point(int n, int (*in)[n], int (*out)[n], int i, int j)
+{
+    if (i == 0 || j == 0 || i == n - 1 || j == n - 1)
+        STORE(out[i][j], LOAD(in[i][j]));
+    else
+        STORE(out[i][j], LOAD(in[i][j]) + LOAD(in[i - 1][j]) +
+              LOAD(in[i + 1][j]) + LOAD(in[i][j - 1]) + LOAD(in[i][j + 1]));
+}
+
+/*
+ * stencil_rows, stencil_cols - 5-point stencil sweeping along rows,
+ *     and down columns
+ */
+static void stencil_rows(int n, int *bufs[])
+{
+    int i, j;
+
+    for (i = 0; i < n; i++)
+        for (j = 0; j < n; j++)
+            stencil_point(n, (int (*)[n])bufs[0], (int (*)[n])bufs[1], i, j);
+}
+
+static void stencil_cols(int n, int *bufs[])
+{
+    int i, j;
+
+    for (j = 0; j < n; j++)
+        for (i = 0; i < n; i++)
+            stencil_point(n, (int (*)[n])bufs[0], (int (*)[n])bufs[1], i, j);
+}
+
+/*
+ * init_gather - Random source values and random indices into them
+ */
+static void init_gather(int n, int *bufs[])
+{
+    int i;
+
+    for (i = 0; i < n * n; i++) {
+        bufs[0][i] = rand();
+        bufs[1][i] = rand() % (n * n);
+        bufs[2][i] = 0;
+    }
+}
+
+static int check_gather(int n, int *bufs[])
+{
+    int i;
+
+    for (i = 0; i < n * n; i++)
+        if (bufs[2][i] != bufs[0][bufs[1][i]])
+            return 0;
+    return 1;
+}
+
+/*
+ * gather - out[i] = src[idx[i]] over n*n random indices
+ */
+static void gather(int n, int *bufs[])
+{
+    int *src = bufs[0], *idx = bufs[1], *out = bufs[2];
+    int i;
+
+    for (i = 0; i < n * n; i++)
+        STORE(out[i], LOAD(src[LOAD(idx[i])]));
+}
+
+static int check_scan(int n, int *bufs[])
+{
+    int i;
+    unsigned int sum = 0;
+
+    for (i = 0; i < n * n; i++) {
+        sum += bufs[0][i];
+        if ((unsigned int)bufs[1][i] != sum)
+            return 0;
+    }
+    return 1;
+}
+
+/*
+ * scan - Inclusive prefix sum of n*n ints, modulo 2^32 so that large
+ *     sizes wrap rather than overflow
+ */
+static void scan(int n, int *bufs[])
+{
+    int *in = bufs[0], *out = bufs[1];
+    int i;
+    unsigned int sum = 0;
+
+    for (i = 0; i < n * n; i++) {
+        sum += LOAD(in[i]);
+        STORE(out[i], (int)sum);
+    }
+}
+
+static kernel_t kernels[] = {
+    { "Matmul ijk", 3,
+      { {"A", DIM_N, DIM_N, 0}, {"B", DIM_N, DIM_N, 0}, {"C", DIM_N, DIM_N, 1} },
+      NULL, matmul_ijk, NULL, check_matmul },
+    { "Matmul ikj", 3,
+      { {"A", DIM_N, DIM_N, 0}, {"B", DIM_N, DIM_N, 0}, {"C", DIM_N, DIM_N, 1} },
+      NULL, matmul_ikj, NULL, check_matmul },
+    { "Matmul ikj, 8x8 blocks", 3,
+      { {"A", DIM_N, DIM_N, 0}, {"B", DIM_N, DIM_N, 0}, {"C", DIM_N, DIM_N, 1} },
+      NULL, matmul_blocked, NULL, check_matmul },
+    { "5-point stencil, row order", 2,
+      { {"in", DIM_N, DIM_N, 0}, {"out", DIM_N, DIM_N, 1} },
+      NULL, stencil_rows, NULL, check_stencil },
+    { "5-point stencil, column order", 2,
+      { {"in", DIM_N, DIM_N, 0}, {"out", DIM_N, DIM_N, 1} },
+      NULL, stencil_cols, NULL, check_stencil },
+    { "Random gather", 3,
+      { {"src", DIM_N, DIM_N, 0}, {"idx", DIM_N, DIM_N, 0}, {"out", DIM_N, DIM_N, 1} },
+      init_gather, gather, NULL, check_gather },
+    { "Inclusive scan", 2,
+      { {"in", DIM_N, DIM_N, 0}, {"out", DIM_N, DIM_N, 1} },
+      NULL, scan, NULL, check_scan },
+};
+
+/*
+ * registerKernels - Register every kernel above with kernlab
+ */
+void registerKernels()
+{
+    int i;
+
+    for (i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++)
+        registerKernel(&kernels[i]);
+}
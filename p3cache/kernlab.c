@@ -0,0 +1,208 @@
+/*
+ * kernlab.c - Cache behavior of the kernels registered in kernels.c
+ *
+ * Every kernel is run natively and validated, then its traced build is
+ * run with every buffer access fed into the embedded cache model, as
+ * test-trans does for transpose functions.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include "cachelab.h"
+#include "cachesim.h"
+
+/* Largest problem size: kernels index their n*n elements with an int */
+#define MAXN 46340
+
+/* Globals defined in cachelab.c */
+extern kernel_t kernel_list[MAX_KERNELS];
+extern int kernel_counter;
+
+/* Defined in kernels.c, once per build */
+extern void registerKernels();
+extern void registerTracedKernels();
+
+/*
+ * kernel_dims - Extents of buffer j of kernel k for problem size n
+ */
+static void kernel_dims(kernel_t *k, int j, int n, int *rows, int *cols)
+{
+    *rows = (k->bufs[j].rows == DIM_N) ? n : k->bufs[j].rows;
+    *cols = (k->bufs[j].cols == DIM_N) ? n : k->bufs[j].cols;
+}
+
+/*
+ * init_kernel - Fill the inputs of kernel k with small random values
+ *     and clear its outputs, unless the kernel brings its own init
+ */
+static void init_kernel(kernel_t *k, int n, int *bufs[])
+{
+    int j, rows, cols;
+    size_t e;
+
+    if (k->init != NULL) {
+        (*k->init)(n, bufs);
+        return;
+    }
+    for (j = 0; j < k->nbufs; j++) {
+        kernel_dims(k, j, n, &rows, &cols);
+        for (e = 0; e < (size_t)rows * cols; e++)
+            bufs[j][e] = k->bufs[j].output ? 0 : rand() % 100;
+    }
+}
+
+/*
+ * eval_kernel - Validate kernel i, then count the hits, misses and
+ *     evictions of its traced build
+ */
+void eval_kernel(int i, int n, unsigned int s, unsigned int E, unsigned int b)
+{
+    kernel_t *k = &kernel_list[i];
+    int *bufs[MAX_KERNEL_BUFS];
+    int j, rows, cols;
+    cachesim_t sim;
+
+    for (j = 0; j < k->nbufs; j++) {
+        kernel_dims(k, j, n, &rows, &cols);
+        bufs[j] = allocMatrix(rows, cols);
+    }
+    if (cacheSimInit(&sim, s, E, b) < 0) {
+        fprintf(stderr, "Unable to allocate the cache model\n");
+        exit(1);
+    }
+
+    printf("\nKernel %d (%d total): %s\n", i, kernel_counter, k->description);
+    if (k->func_ptr != NULL) {
+        init_kernel(k, n, bufs);
+        (*k->func_ptr)(n, bufs);
+        if (!(*k->validate)(n, bufs)) {
+            printf("Validation failed on the native build, skipping kernel\n");
+            goto out;
+        }
+    }
+    if (k->traced_ptr == NULL) {
+        printf("No traced build, skipping kernel\n");
+        goto out;
+    }
+    init_kernel(k, n, bufs);
+    setTraceSink(cacheSimSink, &sim);
+    (*k->traced_ptr)(n, bufs);
+    setTraceSink(NULL, NULL);
+    cacheSimFlush(&sim);
+    if (!(*k->validate)(n, bufs)) {
+        printf("Validation failed on the traced build, skipping kernel\n");
+        goto out;
+    }
+
+    k->correct = 1;
+    k->num_hits = sim.hits;
+    k->num_misses = sim.misses;
+    k->num_evictions = sim.evictions;
+    printf("accesses:%lu hits:%u misses:%u evictions:%u\n",
+           sim.filter.accesses, sim.hits, sim.misses, sim.evictions);
+out:
+    cacheSimFree(&sim);
+    for (j = 0; j < k->nbufs; j++)
+        free(bufs[j]);
+}
+
+/*
+ * print_report - One line per selected kernel, misses next to the
+ *     miss rate
+ */
+void print_report(int n, unsigned int s, unsigned int E, unsigned int b,
+                  char *filter)
+{
+    int i;
+    kernel_t *k;
+    double accesses;
+
+    printf("\nSummary (n=%d, s=%u, E=%u, b=%u)\n", n, s, E, b);
+    printf("%4s %12s %12s %8s  %s\n", "id", "misses", "evictions",
+           "miss %", "description");
+    for (i = 0; i < kernel_counter; i++) {
+        k = &kernel_list[i];
+        if (filter != NULL && strstr(k->description, filter) == NULL)
+            continue;
+        if (!k->correct) {
+            printf("%4d %12s %12s %8s  %s (invalid)\n", i, "-", "-", "-",
+                   k->description);
+            continue;
+        }
+        accesses = (double)k->num_hits + k->num_misses;
+        printf("%4d %12u %12u %8.2f  %s\n", i, k->num_misses,
+               k->num_evictions, 100.0 * k->num_misses / accesses,
+               k->description);
+    }
+}
+
+/*
+ * usage - Print usage info
+ */
+void usage(char *argv[]){
+    printf("Usage: %s [-h] [-n <size>] [-s <s>] [-E <E>] [-b <b>] [-k <text>]\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h          Print this help message.\n");
+    printf("  -n <size>   Problem size (default 64, max %d)\n", MAXN);
+    printf("  -s <s>      Number of set index bits (default 5)\n");
+    printf("  -E <E>      Number of lines per set (default 1)\n");
+    printf("  -b <b>      Number of block offset bits (default 5)\n");
+    printf("  -k <text>   Only kernels whose description contains <text>\n");
+    printf("Example: %s -n 128 -s 8 -E 8 -b 6 -k Matmul\n", argv[0]);
+}
+
+/*
+ * main - Main routine
+ */
+int main(int argc, char* argv[])
+{
+    char c;
+    int i, n = 64;
+    unsigned int s = 5, E = 1, b = 5;
+    char *filter = NULL;
+
+    while ((c = getopt(argc, argv, "n:s:E:b:k:h")) != -1) {
+        switch (c) {
+        case 'n':
+            n = atoi(optarg);
+            break;
+        case 's':
+            s = atoi(optarg);
+            break;
+        case 'E':
+            E = atoi(optarg);
+            break;
+        case 'b':
+            b = atoi(optarg);
+            break;
+        case 'k':
+            filter = optarg;
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+
+    if (n <= 0 || n > MAXN || E == 0) {
+        printf("Error: Invalid argument\n");
+        usage(argv);
+        exit(1);
+    }
+
+    srand(time(NULL));
+    registerKernels();
+    registerTracedKernels();
+    for (i = 0; i < kernel_counter; i++) {
+        if (filter != NULL && strstr(kernel_list[i].description, filter) == NULL)
+            continue;
+        eval_kernel(i, n, s, E, b);
+    }
+    print_report(n, s, E, b, filter);
+    return 0;
+}
@@ -0,0 +1,289 @@
+/*
+ * ptrans.c - Multithreaded tiled transpose with work stealing
+ *
+ * The deques follow Chase and Lev: the owner pushes and pops at the
+ * bottom without locking, thieves take from the top with a CAS. All
+ * tiles are pushed by ptransDeal before the workers start, so a deque
+ * never grows while they run, and dealing, allocation included, stays
+ * out of what the caller times.
+ */
+#define _POSIX_C_SOURCE 200112L /* for pthread barriers under -std=c99 */
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "ptrans.h"
+
+#define EMPTY (-1)
+#define ABORT (-2)
+
+/* Keep each deque's hot indices on their own cache line; the array
+   of deques is allocated on a line boundary for this to hold */
+#define LINE 64
+
+typedef struct deque {
+    long top;                   /* next slot thieves take */
+    long bottom;                /* next slot the owner pushes into */
+    int *tasks;                 /* tile numbers */
+    long cap;                   /* slots in tasks */
+    char pad[LINE - 3 * sizeof(long) - sizeof(int *)];
+} deque_t;
+
+/* What the workers run on; set by the caller between barriers */
+typedef enum { JOB_TOUCH, JOB_TRANSPOSE, JOB_QUIT } job_kind_t;
+
+static struct {
+    int nthreads;
+    pthread_t *tids;
+    deque_t *deques;
+    pthread_barrier_t start, done;
+    job_kind_t kind;
+    int M, N;
+    int *A, *B;
+    int tile_rows, tile_cols;   /* tiles of B */
+    long remaining;             /* tiles not yet transposed */
+    long steals;
+} pool;
+
+/*
+ * owned_range - The contiguous band of tiles worker w starts out with
+ */
+static void owned_range(int w, int ntiles, int *lo, int *hi)
+{
+    *lo = (int)((long)ntiles * w / pool.nthreads);
+    *hi = (int)((long)ntiles * (w + 1) / pool.nthreads);
+}
+
+static void push(deque_t *d, int task)
+{
+    long b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+    d->tasks[b] = task;
+    __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELEASE);
+}
+
+static int pop(deque_t *d)
+{
+    long b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1;
+    long t;
+    int task;
+
+    __atomic_store_n(&d->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    t = __atomic_load_n(&d->top, __ATOMIC_RELAXED);
+    if (t > b) {
+        /* Empty: undo the claim */
+        __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+        return EMPTY;
+    }
+    task = d->tasks[b];
+    if (t == b) {
+        /* Last task: race the thieves for it */
+        if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, 0,
+                                         __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+            task = EMPTY;
+        __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+    return task;
+}
+
+static int steal(deque_t *d)
+{
+    long t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+    long b;
+    int task;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    b = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+    if (t >= b)
+        return EMPTY;
+    task = d->tasks[t];
+    if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, 0,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+        return ABORT;
+    return task;
+}
+
+/*
+ * do_tile - Transpose one tile of B in 8x8 blocks
+ */
+static void do_tile(int tile)
+{
+    int M = pool.M, N = pool.N;
+    int (*A)[M] = (int (*)[M])pool.A;
+    int (*B)[N] = (int (*)[N])pool.B;
+    int j0 = (tile / pool.tile_cols) * PTRANS_TILE;    /* rows of B */
+    int i0 = (tile % pool.tile_cols) * PTRANS_TILE;    /* columns of B */
+    int j1 = (j0 + PTRANS_TILE < M) ? j0 + PTRANS_TILE : M;
+    int i1 = (i0 + PTRANS_TILE < N) ? i0 + PTRANS_TILE : N;
+    int i, j, ii, jj;
+
+    for (jj = j0; jj < j1; jj += 8)
+        for (ii = i0; ii < i1; ii += 8)
+            for (i = ii; i < ii + 8 && i < i1; i++)
+                for (j = jj; j < jj + 8 && j < j1; j++)
+                    B[j][i] = A[i][j];
+}
+
+/*
+ * touch_tiles - Zero the rows of B that worker w's tiles cover
+ */
+static void touch_tiles(int w)
+{
+    int M = pool.M, N = pool.N;
+    int (*B)[N] = (int (*)[N])pool.B;
+    int lo, hi, t, j, j0, i0, i1;
+
+    owned_range(w, pool.tile_rows * pool.tile_cols, &lo, &hi);
+    for (t = lo; t < hi; t++) {
+        j0 = (t / pool.tile_cols) * PTRANS_TILE;
+        i0 = (t % pool.tile_cols) * PTRANS_TILE;
+        i1 = (i0 + PTRANS_TILE < N) ? i0 + PTRANS_TILE : N;
+        for (j = j0; j < j0 + PTRANS_TILE && j < M; j++)
+            memset(&B[j][i0], 0, (i1 - i0) * sizeof(int));
+    }
+}
+
+/*
+ * run_tiles - Drain our own deque, then steal until no tiles are left
+ */
+static void run_tiles(int w)
+{
+    unsigned int seed = w + 1;
+    long steals = 0;
+    int task, victim;
+
+    while (__atomic_load_n(&pool.remaining, __ATOMIC_ACQUIRE) > 0) {
+        task = pop(&pool.deques[w]);
+        if (task == EMPTY && pool.nthreads > 1) {
+            victim = rand_r(&seed) % (pool.nthreads - 1);
+            if (victim >= w)
+                victim++;
+            task = steal(&pool.deques[victim]);
+            if (task >= 0)
+                steals++;
+        }
+        if (task >= 0) {
+            do_tile(task);
+            __atomic_sub_fetch(&pool.remaining, 1, __ATOMIC_RELEASE);
+        }
+    }
+    __atomic_add_fetch(&pool.steals, steals, __ATOMIC_RELAXED);
+}
+
+static void run_job(int w)
+{
+    if (pool.kind == JOB_TOUCH)
+        touch_tiles(w);
+    else
+        run_tiles(w);
+}
+
+static void *worker(void *arg)
+{
+    int w = (int)(long)arg;
+
+    for (;;) {
+        pthread_barrier_wait(&pool.start);
+        if (pool.kind == JOB_QUIT)
+            return NULL;
+        run_job(w);
+        pthread_barrier_wait(&pool.done);
+    }
+}
+
+/*
+ * start_job - Publish a job, take part in it as worker 0 and wait for
+ *     the others to finish
+ */
+static void start_job(job_kind_t kind, int M, int N, int *A, int *B)
+{
+    pool.kind = kind;
+    pool.M = M;
+    pool.N = N;
+    pool.A = A;
+    pool.B = B;
+    pool.tile_rows = (M + PTRANS_TILE - 1) / PTRANS_TILE;
+    pool.tile_cols = (N + PTRANS_TILE - 1) / PTRANS_TILE;
+    pthread_barrier_wait(&pool.start);
+    run_job(0);
+    pthread_barrier_wait(&pool.done);
+}
+
+int ptransInit(int nthreads)
+{
+    long w;
+
+    pool.nthreads = nthreads;
+    pool.tids = calloc(nthreads, sizeof(pthread_t));
+    if (pool.tids == NULL ||
+        posix_memalign((void **)&pool.deques, LINE, nthreads * sizeof(deque_t)) != 0)
+        return -1;
+    memset(pool.deques, 0, nthreads * sizeof(deque_t));
+    if (pthread_barrier_init(&pool.start, NULL, nthreads) != 0 ||
+        pthread_barrier_init(&pool.done, NULL, nthreads) != 0)
+        return -1;
+    for (w = 1; w < nthreads; w++)
+        if (pthread_create(&pool.tids[w], NULL, worker, (void *)w) != 0)
+            return -1;
+    return 0;
+}
+
+void ptransFree(void)
+{
+    int w;
+
+    pool.kind = JOB_QUIT;
+    pthread_barrier_wait(&pool.start);
+    for (w = 1; w < pool.nthreads; w++)
+        pthread_join(pool.tids[w], NULL);
+    for (w = 0; w < pool.nthreads; w++)
+        free(pool.deques[w].tasks);
+    pthread_barrier_destroy(&pool.start);
+    pthread_barrier_destroy(&pool.done);
+    free(pool.tids);
+    free(pool.deques);
+}
+
+void ptransFirstTouch(int M, int N, int B[M][N])
+{
+    start_job(JOB_TOUCH, M, N, NULL, &B[0][0]);
+}
+
+int ptransDeal(int M, int N)
+{
+    int w, t, lo, hi;
+    int ntiles = ((M + PTRANS_TILE - 1) / PTRANS_TILE) *
+                 ((N + PTRANS_TILE - 1) / PTRANS_TILE);
+    deque_t *d;
+
+    /* Deal out the bands; pushed last-first so each owner walks its
+       band in order while thieves take from the far end */
+    for (w = 0; w < pool.nthreads; w++) {
+        d = &pool.deques[w];
+        owned_range(w, ntiles, &lo, &hi);
+        if (d->cap < hi - lo) {
+            free(d->tasks);
+            if ((d->tasks = malloc((hi - lo) * sizeof(int))) == NULL) {
+                d->cap = 0;
+                return -1;
+            }
+            d->cap = hi - lo;
+        }
+        d->top = 0;
+        d->bottom = 0;
+        for (t = hi - 1; t >= lo; t--)
+            push(d, t);
+    }
+    pool.remaining = ntiles;
+    pool.steals = 0;
+    return 0;
+}
+
+void ptransTranspose(int M, int N, int A[N][M], int B[M][N])
+{
+    start_job(JOB_TRANSPOSE, M, N, &A[0][0], &B[0][0]);
+}
+
+long ptransSteals(void)
+{
+    return pool.steals;
+}
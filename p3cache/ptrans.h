@@ -0,0 +1,36 @@
+/*
+ * ptrans.h - Multithreaded tiled transpose
+ *
+ * B is cut into PTRANS_TILE x PTRANS_TILE tiles. Each worker starts
+ * with a contiguous band of tiles in its own work-stealing deque and
+ * steals from the others when it runs dry. The band a worker owns is
+ * also the part of B it first-touches, so on NUMA hosts the pages of
+ * B land on the node of the thread that writes them.
+ */
+
+#ifndef PTRANS_H
+#define PTRANS_H
+
+/* Edge of a square tile: 64x64 ints of A and B together fill 32KB */
+#define PTRANS_TILE 64
+
+/* Start a pool of nthreads workers (the caller is worker 0) */
+int ptransInit(int nthreads);
+
+/* Stop the pool */
+void ptransFree(void);
+
+/* Zero B, every worker writing the tiles it starts out owning */
+void ptransFirstTouch(int M, int N, int B[M][N]);
+
+/* Deal the tiles of an M x N B out to the workers; needed before
+   every ptransTranspose, and kept apart so it can be left untimed */
+int ptransDeal(int M, int N);
+
+/* B = A^T with the whole pool, on the tiles last dealt for M x N */
+void ptransTranspose(int M, int N, int A[N][M], int B[M][N]);
+
+/* Number of tiles stolen during the last ptransTranspose() */
+long ptransSteals(void);
+
+#endif /* PTRANS_H */
@@ -3,6 +3,7 @@
  *     student's transpose functions and records the results for their
  *     official submitted version as well.
  */
+#define _POSIX_C_SOURCE 200809L /* for popen() under -std=c99 */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -12,18 +13,33 @@
 #include <getopt.h>
 #include <sys/types.h>
 #include "cachelab.h"
+#include "cachesim.h"
+#include "ptrans.h"
+#include "perfctr.h"
 #include <sys/wait.h> // for WEXITSTATUS
 #include <limits.h> // for INT_MAX
+#include <time.h> // for clock_gettime
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h> // for __rdtsc
+#endif
 
 /* Maximum array dimension */
-#define MAXN 256
+#define MAXN 16384
+
+/* Maximum timed runs per function; the timings are kept on the stack */
+#define MAXREPS 10000
 
 /* The description string for the transpose_submit() function that the
    student submits for credit */
 #define SUBMIT_DESCRIPTION "Transpose submission"
 
-/* External function defined in trans.c */
+/* External functions defined in the native and traced builds of trans.c */
 extern void registerFunctions();
+extern void registerTracedFunctions();
+
+/* Bytes streamed through before each cold-cache benchmark run; larger
+   than the last-level cache of any machine we run on */
+#define FLUSH_BYTES (64 << 20)
 
 /* External variables defined in cachelab-tools.c */
 extern trans_func_t func_list[MAX_TRANS_FUNCS];
@@ -32,6 +48,16 @@ extern int func_counter;
 /* Globals set on the command line */
 static int M = 0;
 static int N = 0;
+static int use_lackey = 0;
+static int jobs = 1;
+static int bench_reps = 0;
+static int counters = 0;
+static int max_threads = 0;
+
+/* Matrices for in-process evaluation. They are page aligned, as in
+   tracegen, so that both paths map A and B onto the same cache sets. */
+static int *A;
+static int *B;
 
 /* The correctness and performance for the submitted transpose function */
 struct results {
@@ -41,134 +67,574 @@ struct results {
 };
 static struct results results = {-1, 0, INT_MAX};
 
+/*
+ * print_regions - Split the misses of a run by region; accesses
+ *     outside every region only show up when there are some
+ */
+static void print_regions(FILE *out, cachesim_t *sim)
+{
+    int r;
+
+    fprintf(out, "misses by region:");
+    for (r = 0; r < sim->nregions; r++)
+        fprintf(out, " %s:%u", sim->regions[r].name, sim->region_misses[r]);
+    if (sim->region_hits[r] + sim->region_misses[r] > 0)
+        fprintf(out, " other:%u", sim->region_misses[r]);
+    fputc('\n', out);
+}
+
+/*
+ * eval_lackey - Validate function i and count its misses by running
+ *     tracegen under valgrind lackey. The trace is read from a pipe
+ *     and fed straight into the embedded cache model, so no trace or
+ *     result files are written. Progress is logged to out. Returns 0
+ *     if the function failed validation.
+ */
+int eval_lackey(FILE *out, int i, unsigned int s, unsigned int E, unsigned int b,
+                unsigned int *hits, unsigned int *misses,
+                unsigned int *evictions)
+{
+    int flag, status, size, nregions = 0;
+    unsigned int count;
+    trace_region_t regions[MAX_REGIONS];
+    unsigned long addr;
+    unsigned long long int marker_start = 0, marker_end = 0;
+    char op, buf[1000], cmd[255];
+    FILE *trace_fp;
+    cachesim_t sim;
+
+    if (cacheSimInit(&sim, s, E, b) < 0) {
+        fprintf(stderr, "Unable to allocate the cache model\n");
+        exit(1);
+    }
+
+    /* Use valgrind to generate the trace; tracegen -m prints the
+       regions and marker addresses into the same stream ahead of
+       the trace */
+    sprintf(cmd, "valgrind --tool=lackey --trace-mem=yes --log-fd=1 -v ./tracegen -m -M %d -N %d -F %d",
+            M, N, i);
+    trace_fp = popen(cmd, "r");
+    assert(trace_fp);
+
+    /* Locate trace corresponding to the trans function */
+    flag = 0;
+    while (fgets(buf, sizeof(buf), trace_fp) != NULL) {
+        if (strncmp(buf, "REGION ", 7) == 0 && nregions < MAX_REGIONS) {
+            if (sscanf(buf + 7, "%15s %lx %lx", regions[nregions].name,
+                       &regions[nregions].lo, &regions[nregions].hi) == 3)
+                cacheSimSetRegions(&sim, regions, ++nregions);
+            continue;
+        }
+        if (strncmp(buf, "MARKERS ", 8) == 0) {
+            sscanf(buf + 8, "%llx %llx", &marker_start, &marker_end);
+            continue;
+        }
+        if (strncmp(buf, "Validation failed", 17) == 0) {
+            fputs(buf, out);
+            continue;
+        }
+
+        /* We are only interested in memory access instructions */
+        if (!parseTraceLine(buf, &op, &addr, &size, &count) || op == 'I')
+            continue;
+
+        /* If start marker found, set flag */
+        if (addr == marker_start)
+            flag = 1;
+
+        /* Keep only accesses to A, B and the stack tracegen runs
+           the function on; this drops valgrind's own stack traffic
+           and any globals while keeping the function's temporaries */
+        if (flag && findRegion(regions, nregions, addr) >= 0)
+            cacheSimPush(&sim, op, addr, size);
+
+        /* Keep draining the pipe after the end marker so that
+           tracegen is not killed by SIGPIPE */
+        if (addr == marker_end)
+            flag = 0;
+    }
+    status = pclose(trace_fp);
+    flag = WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+    if (0!=flag) {
+        fprintf(out, "Validation error at function %d! Run ./tracegen -M %d -N %d -F %d for details.\nSkipping performance evaluation for this function.\n",flag-1,M,N,i);
+        cacheSimFree(&sim);
+        return 0;
+    }
+    cacheSimFlush(&sim);
+
+    fprintf(out, "Step 2: Evaluating performance (s=%d, E=%d, b=%d)\n", s, E, b);
+    print_regions(out, &sim);
+    *hits = sim.hits;
+    *misses = sim.misses;
+    *evictions = sim.evictions;
+    cacheSimFree(&sim);
+    return 1;
+}
+
+/*
+ * eval_inprocess - Validate function i and count its misses by
+ *     running the instrumented build of it with every A and B access
+ *     fed straight into an embedded cache model. Progress is logged to
+ *     out. Returns 0 if the function failed validation.
+ */
+int eval_inprocess(FILE *out, int i, unsigned int s, unsigned int E, unsigned int b,
+                   unsigned int *hits, unsigned int *misses,
+                   unsigned int *evictions)
+{
+    int r, c;
+    cachesim_t sim;
+    int (*a)[M] = (int (*)[M])A;
+    int (*bm)[N] = (int (*)[N])B;
+    trace_region_t regions[2] = {
+        {"A", (unsigned long)A, (unsigned long)(A + (size_t)M * N)},
+        {"B", (unsigned long)B, (unsigned long)(B + (size_t)M * N)},
+    };
+
+    if (cacheSimInit(&sim, s, E, b) < 0) {
+        fprintf(stderr, "Unable to allocate the cache model\n");
+        exit(1);
+    }
+    cacheSimSetRegions(&sim, regions, 2);
+
+    initMatrix(M, N, a, bm);
+    setTraceSink(cacheSimSink, &sim);
+    (*func_list[i].traced_ptr)(M, N, a, bm);
+    setTraceSink(NULL, NULL);
+    cacheSimFlush(&sim);
+
+    for (r = 0; r < N; r++) {
+        for (c = 0; c < M; c++) {
+            if (bm[c][r] != a[r][c]) {
+                fprintf(out, "Validation failed on function %d! Expected %d but got %d at B[%d][%d]\n",
+                       i, a[r][c], bm[c][r], c, r);
+                fprintf(out, "Skipping performance evaluation for this function.\n");
+                cacheSimFree(&sim);
+                return 0;
+            }
+        }
+    }
+
+    fprintf(out, "Step 2: Evaluating performance (s=%d, E=%d, b=%d)\n", s, E, b);
+    print_regions(out, &sim);
+    *hits = sim.hits;
+    *misses = sim.misses;
+    *evictions = sim.evictions;
+    cacheSimFree(&sim);
+    return 1;
+}
+
+/*
+ * eval_func - Validate and simulate function i, logging to out, and
+ *     record the outcome in func_list[i]
+ */
+void eval_func(FILE *out, int i, unsigned int s, unsigned int E, unsigned int b)
+{
+    int ok;
+    unsigned int hits, misses, evictions;
+
+    fprintf(out, "\nFunction %d (%d total)\nStep 1: Validating and generating memory traces\n",i,func_counter);
+    if (use_lackey)
+        ok = eval_lackey(out, i, s, E, b, &hits, &misses, &evictions);
+    else
+        ok = eval_inprocess(out, i, s, E, b, &hits, &misses, &evictions);
+    if (!ok)
+        return;
+
+    func_list[i].correct=1;
+    func_list[i].num_hits = hits;
+    func_list[i].num_misses = misses;
+    func_list[i].num_evictions = evictions;
+    fprintf(out, "func %u (%s): hits:%u, misses:%u, evictions:%u\n",
+            i, func_list[i].description, hits, misses, evictions);
+}
+
+/* What a worker sends back for each function. Small enough to be
+   written to the result pipe atomically (see PIPE_BUF). */
+struct job_result {
+    int funcid;
+    char correct;
+    unsigned int num_hits;
+    unsigned int num_misses;
+    unsigned int num_evictions;
+    char log[2048];
+};
+
+/* Ends a log that did not fit in job_result.log */
+#define LOG_CUT "[log truncated]\n"
+
+/*
+ * eval_worker - Body of a worker process: take function ids from the
+ *     task pipe until it runs dry, evaluate each one and send back its
+ *     result and log
+ */
+void eval_worker(int task_fd, int result_fd,
+                 unsigned int s, unsigned int E, unsigned int b)
+{
+    int i;
+    char *log;
+    size_t loglen, n;
+    FILE *out;
+    struct job_result r;
+
+    /* Let a crash kill the worker so that the parent reports it */
+    signal(SIGSEGV, SIG_DFL);
+
+    while (read(task_fd, &i, sizeof(i)) == sizeof(i)) {
+        out = open_memstream(&log, &loglen);
+        assert(out);
+        eval_func(out, i, s, E, b);
+        fclose(out);
+
+        memset(&r, 0, sizeof(r));
+        r.funcid = i;
+        r.correct = func_list[i].correct;
+        r.num_hits = func_list[i].num_hits;
+        r.num_misses = func_list[i].num_misses;
+        r.num_evictions = func_list[i].num_evictions;
+        if (loglen < sizeof(r.log)) {
+            memcpy(r.log, log, loglen + 1);
+        } else {
+            /* Keep the whole lines that fit and say so */
+            n = sizeof(r.log) - sizeof(LOG_CUT);
+            while (n > 0 && log[n - 1] != '\n')
+                n--;
+            memcpy(r.log, log, n);
+            strcpy(r.log + n, LOG_CUT);
+        }
+        free(log);
+        if (write(result_fd, &r, sizeof(r)) != sizeof(r))
+            exit(1);
+    }
+    exit(0);
+}
+
+/*
+ * eval_parallel - Evaluate the registered functions with a pool of
+ *     forked workers. Every worker has its own copy of the matrices and
+ *     the cache model, so nothing is shared but the two pipes. Results
+ *     are printed in registration order once they are all in.
+ */
+void eval_parallel(int jobs, unsigned int s, unsigned int E, unsigned int b)
+{
+    int i, w, status, done = 0, failed = 0;
+    int task_pipe[2], result_pipe[2];
+    pid_t pid;
+    struct job_result r;
+    static char logs[MAX_TRANS_FUNCS][sizeof(r.log)];
+
+    assert(sizeof(r) <= PIPE_BUF);
+    if (pipe(task_pipe) < 0 || pipe(result_pipe) < 0) {
+        perror("pipe");
+        exit(1);
+    }
+
+    /* Queue every function up front; workers pull them as they go */
+    for (i = 0; i < func_counter; i++) {
+        if (write(task_pipe[1], &i, sizeof(i)) != sizeof(i)) {
+            perror("write");
+            exit(1);
+        }
+    }
+    close(task_pipe[1]);
+
+    fflush(stdout);
+    for (w = 0; w < jobs && w < func_counter; w++) {
+        if ((pid = fork()) < 0) {
+            perror("fork");
+            exit(1);
+        }
+        if (pid == 0) {
+            close(result_pipe[0]);
+            eval_worker(task_pipe[0], result_pipe[1], s, E, b);
+        }
+    }
+    close(task_pipe[0]);
+    close(result_pipe[1]);
+
+    while (done < func_counter &&
+           read(result_pipe[0], &r, sizeof(r)) == sizeof(r)) {
+        func_list[r.funcid].correct = r.correct;
+        func_list[r.funcid].num_hits = r.num_hits;
+        func_list[r.funcid].num_misses = r.num_misses;
+        func_list[r.funcid].num_evictions = r.num_evictions;
+        memcpy(logs[r.funcid], r.log, sizeof(r.log));
+        done++;
+    }
+    close(result_pipe[0]);
+
+    while (wait(&status) > 0) {
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            failed = 1;
+    }
+    if (failed || done < func_counter) {
+        printf("Error: Segmentation Fault.\n");
+        printf("TEST_TRANS_RESULTS=0:0\n");
+        exit(1);
+    }
+
+    for (i = 0; i < func_counter; i++)
+        fputs(logs[i], stdout);
+}
+
 /*
  * eval_perf - Evaluate the performance of the registered transpose functions
  */
 void eval_perf(unsigned int s, unsigned int E, unsigned int b)
 {
-    int i,flag;
-    unsigned int len, hits, misses, evictions;
-    unsigned long long int marker_start, marker_end, addr;
-    char buf[1000], cmd[255];
-    char filename[128], tmpname[512];
+    int i;
 
     registerFunctions();
-
-    /* Open the complete trace file */
-    FILE* full_trace_fp;
-    FILE* part_trace_fp;
+    registerTracedFunctions();
 
     /* Evaluate the performance of each registered transpose function */
+    if (jobs > 1) {
+        eval_parallel(jobs, s, E, b);
+    } else {
+        for (i=0; i<func_counter; i++)
+            eval_func(stdout, i, s, E, b);
+    }
 
     for (i=0; i<func_counter; i++) {
         if (strcmp(func_list[i].description, SUBMIT_DESCRIPTION) == 0 )
             results.funcid = i; /* remember which function is the submission */
 
+        /* Save the correctness and misses of the transpose submission */
+        if (results.funcid == i && func_list[i].correct) {
+            results.correct = 1;
+            results.misses = func_list[i].num_misses;
+        }
+    }
 
-        printf("\nFunction %d (%d total)\nStep 1: Validating and generating memory traces\n",i,func_counter);
-        /* Use valgrind to generate the trace */
+}
 
-	sprintf(tmpname, "/tmp/cs154p3-%u.tmp", (unsigned int)getuid());
-        sprintf(cmd, "valgrind --tool=lackey --trace-mem=yes --log-fd=1 -v ./tracegen -M %d -N %d -F %d  > %s",
-		M, N,i, tmpname);
-        flag=WEXITSTATUS(system(cmd));
-        if (0!=flag) {
-            printf("Validation error at function %d! Run ./tracegen -M %d -N %d -F %d for details.\nSkipping performance evaluation for this function.\n",flag-1,M,N,i);
-            continue;
-        }
+/*
+ * now_secs, now_cycles - Wall-clock time and time-stamp counter
+ */
+static double now_secs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
 
-        /* Get the start and end marker addresses */
-        FILE* marker_fp = fopen(".marker", "r");
-        assert(marker_fp);
-        fscanf(marker_fp, "%llx %llx", &marker_start, &marker_end);
-        fclose(marker_fp);
+static unsigned long long now_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static int cmp_double(const void *x, const void *y)
+{
+    double a = *(const double *)x, b = *(const double *)y;
+    return (a > b) - (a < b);
+}
+
+/*
+ * bench_func - Median seconds and cycles per call of the native build
+ *     of function i over reps calls. With cold set, a buffer larger than
+ *     the caches is written before every call so that A and B start
+ *     out in memory; otherwise the first, untimed call warms them up.
+ */
+void bench_func(int i, int reps, int cold, char *flush_buf,
+                double *secs, double *cycles)
+{
+    int r;
+    double t[reps], c[reps], t0;
+    unsigned long long c0;
+    int (*a)[M] = (int (*)[M])A;
+    int (*bm)[N] = (int (*)[N])B;
+
+    if (!cold)
+        (*func_list[i].func_ptr)(M, N, a, bm);
+    for (r = 0; r < reps; r++) {
+        if (cold)
+            memset(flush_buf, r, FLUSH_BYTES);
+        t0 = now_secs();
+        c0 = now_cycles();
+        (*func_list[i].func_ptr)(M, N, a, bm);
+        c[r] = (double)(now_cycles() - c0);
+        t[r] = now_secs() - t0;
+    }
+    qsort(t, reps, sizeof(double), cmp_double);
+    qsort(c, reps, sizeof(double), cmp_double);
+    *secs = t[reps / 2];
+    *cycles = c[reps / 2];
+}
 
+/* perf_measure() takes a single pointer; this is what it points to */
+struct perf_arg {
+    int funcid;
+};
 
-        func_list[i].correct=1;
+static void perf_run(void *arg)
+{
+    int i = ((struct perf_arg *)arg)->funcid;
+    (*func_list[i].func_ptr)(M, N, (int (*)[M])A, (int (*)[N])B);
+}
 
-        /* Save the correctness of the transpose submission */
-        if (results.funcid == i ) {
-            results.correct = 1;
+/*
+ * eval_counters - Read the hardware counters and the software clock
+ *     over one warm run of every native function, next to the misses
+ *     the model predicted. Counters that cannot be opened print "-".
+ */
+void eval_counters(void)
+{
+    int i, c, n;
+    struct perf_arg arg;
+    perf_sample_t sample;
+
+    n = perf_init();
+    printf("\nHardware counters (%dx%d, one warm run)\n", M, N);
+    if (perf_status()[0] != '\0')
+        printf("%s%s\n", perf_status(), n == 0 ? "; software clock only" : "");
+    printf("%4s %10s %10s", "func", "sim miss", "usecs");
+    for (c = 0; c < PERF_NCOUNTERS; c++)
+        printf(" %10s", perf_name(c));
+    printf("  description\n");
+    for (i = 0; i < func_counter; i++) {
+        if (func_list[i].func_ptr == NULL)
+            continue;
+        arg.funcid = i;
+        perf_run(&arg);
+        perf_measure(perf_run, &arg, &sample);
+        if (func_list[i].correct)
+            printf("%4d %10u", i, func_list[i].num_misses);
+        else
+            printf("%4d %10s", i, "-");
+        printf(" %10.2f", sample.secs * 1e6);
+        for (c = 0; c < PERF_NCOUNTERS; c++) {
+            if (sample.valid[c])
+                printf(" %10llu", sample.count[c]);
+            else
+                printf(" %10s", "-");
         }
+        printf("  %s\n", func_list[i].description);
+    }
+    perf_close();
+}
 
-        full_trace_fp = fopen(tmpname, "r");
-        assert(full_trace_fp);
-
-
-        /* Filtered trace for each transpose function goes in a separate file */
-        sprintf(filename, "trace.f%d", i);
-        part_trace_fp = fopen(filename, "w");
-        assert(part_trace_fp);
-
-        /* Locate trace corresponding to the trans function */
-        flag = 0;
-        while (fgets(buf, 1000, full_trace_fp) != NULL) {
-
-            /* We are only interested in memory access instructions */
-            if (buf[0]==' ' && buf[2]==' ' &&
-                (buf[1]=='S' || buf[1]=='M' || buf[1]=='L' )) {
-                sscanf(buf+3, "%llx,%u", &addr, &len);
-
-                /* If start marker found, set flag */
-                if (addr == marker_start)
-                    flag = 1;
-
-                /* Valgrind creates many spurious accesses to the
-                   stack that have nothing to do with the students
-                   code. At the moment, we are ignoring all stack
-                   accesses by using the simple filter of recording
-                   accesses to only the low 32-bit portion of the
-                   address space. At some point it would be nice to
-                   try to do more informed filtering so that would
-                   eliminate the valgrind stack references while
-                   include the student stack references. */
-                if (flag && addr < 0xffffffff) {
-                    fputs(buf, part_trace_fp);
-                }
+/*
+ * eval_bench - Time the native build of every registered function with
+ *     warm and cold caches, and print the throughput next to the
+ *     simulated misses. Bandwidth counts A read once and B written once.
+ */
+void eval_bench(int reps)
+{
+    int i, r, c;
+    double warm_secs, warm_cycles, cold_secs, cold_cycles;
+    double elems = (double)M * N, bytes = 2.0 * elems * sizeof(int);
+    char *flush_buf;
+    int (*a)[M] = (int (*)[M])A;
+    int (*bm)[N] = (int (*)[N])B;
+
+    if ((flush_buf = malloc(FLUSH_BYTES)) == NULL) {
+        fprintf(stderr, "Unable to allocate the cache flush buffer\n");
+        exit(1);
+    }
 
-                /* if end marker found, close trace file */
-                if (addr == marker_end) {
-                    flag = 0;
-                    fclose(part_trace_fp);
-                    break;
-                }
-            }
+    printf("\nNative benchmark (%dx%d, median of %d runs, cycles from the TSC)\n",
+           M, N, reps);
+    printf("%4s %10s %10s %10s %10s %10s  %s\n", "func", "misses",
+           "warm GB/s", "cyc/elem", "cold GB/s", "cyc/elem", "description");
+    for (i = 0; i < func_counter; i++) {
+        if (func_list[i].func_ptr == NULL)
+            continue;
+        initMatrix(M, N, a, bm);
+        bench_func(i, reps, 0, flush_buf, &warm_secs, &warm_cycles);
+        bench_func(i, reps, 1, flush_buf, &cold_secs, &cold_cycles);
+
+        /* The timed runs must also be transposes */
+        for (r = 0; r < N; r++)
+            for (c = 0; c < M; c++)
+                if (bm[c][r] != a[r][c])
+                    goto invalid;
+
+        if (func_list[i].correct)
+            printf("%4d %10u", i, func_list[i].num_misses);
+        else
+            printf("%4d %10s", i, "-");
+        printf(" %10.2f %10.2f %10.2f %10.2f  %s\n",
+               bytes / warm_secs / 1e9, warm_cycles / elems,
+               bytes / cold_secs / 1e9, cold_cycles / elems,
+               func_list[i].description);
+        continue;
+    invalid:
+        printf("%4d %10s %10s %10s %10s %10s  %s (not a transpose)\n", i,
+               "-", "-", "-", "-", "-", func_list[i].description);
+    }
+    free(flush_buf);
+}
+
+/*
+ * eval_threads - Time the work-stealing parallel transpose with 1 to
+ *     max_threads threads. Each thread count gets a fresh B that its
+ *     pool first-touches, so B's pages sit with the threads writing them.
+ */
+void eval_threads(int max_threads, int reps)
+{
+    int nthreads, r, c;
+    int (*a)[M] = (int (*)[M])A;
+    int (*bm)[N];
+    int *fresh_b;
+    double t[reps], t0, base = 0;
+    double bytes = 2.0 * M * N * sizeof(int);
+
+    printf("\nParallel transpose (%dx%d, %dx%d tiles, median of %d runs)\n",
+           M, N, PTRANS_TILE, PTRANS_TILE, reps);
+    printf("%7s %10s %10s %10s\n", "threads", "GB/s", "speedup", "steals");
+    for (nthreads = 1; nthreads <= max_threads; nthreads++) {
+        if (ptransInit(nthreads) < 0) {
+            fprintf(stderr, "Unable to start %d threads\n", nthreads);
+            exit(1);
         }
-        fclose(full_trace_fp);
-
-        /* Run the reference simulator */
-        printf("Step 2: Evaluating performance (s=%d, E=%d, b=%d)\n", s, E, b);
-        char cmd[255];
-        sprintf(cmd, "./csim-ref -s %u -E %u -b %u -t trace.f%d > /dev/null",
-                s, E, b, i);
-        system(cmd);
-
-        /* Collect results from the reference simulator */
-        FILE* in_fp = fopen(".csim_results","r");
-        assert(in_fp);
-        fscanf(in_fp, "%u %u %u", &hits, &misses, &evictions);
-        fclose(in_fp);
-        func_list[i].num_hits = hits;
-        func_list[i].num_misses = misses;
-        func_list[i].num_evictions = evictions;
-        printf("func %u (%s): hits:%u, misses:%u, evictions:%u\n",
-               i, func_list[i].description, hits, misses, evictions);
-
-        /* If it is transpose_submit(), record number of misses */
-        if (results.funcid == i) {
-            results.misses = misses;
+        fresh_b = allocMatrix(M, N);
+        bm = (int (*)[N])fresh_b;
+        ptransFirstTouch(M, N, bm);
+
+        for (r = -1; r < reps; r++) {      /* the first run warms up */
+            if (ptransDeal(M, N) < 0) {
+                fprintf(stderr, "Unable to deal %dx%d tiles\n", M, N);
+                exit(1);
+            }
+            t0 = now_secs();
+            ptransTranspose(M, N, a, bm);
+            if (r >= 0)
+                t[r] = now_secs() - t0;
         }
+        qsort(t, reps, sizeof(double), cmp_double);
+        if (nthreads == 1)
+            base = t[reps / 2];
+
+        for (r = 0; r < N; r++)
+            for (c = 0; c < M; c++)
+                if (bm[c][r] != a[r][c]) {
+                    printf("%7d %10s %10s %10s (not a transpose)\n",
+                           nthreads, "-", "-", "-");
+                    goto next;
+                }
+        printf("%7d %10.2f %10.2f %10ld\n", nthreads, bytes / t[reps / 2] / 1e9,
+               base / t[reps / 2], ptransSteals());
+    next:
+        free(fresh_b);
+        ptransFree();
     }
-
 }
 
 /*
  * usage - Print usage info
  */
 void usage(char *argv[]){
-    printf("Usage: %s [-h] -M <rows> -N <cols>\n", argv[0]);
+    printf("Usage: %s [-hLC] [-j <jobs>] [-T <reps>] [-P <threads>] -M <rows> -N <cols>\n", argv[0]);
     printf("Options:\n");
     printf("  -h          Print this help message.\n");
+    printf("  -L          Trace with valgrind lackey instead of in-process.\n");
+    printf("  -j <jobs>   Evaluate up to <jobs> functions concurrently.\n");
+    printf("  -T <reps>   Also time the native functions over <reps> runs (max %d).\n", MAXREPS);
+    printf("  -P <threads> Also time the parallel transpose on 1..<threads> threads.\n");
+    printf("  -C          Also read the hardware counters over one warm run.\n");
     printf("  -M <rows>   Number of matrix rows (max %d)\n", MAXN);
     printf("  -N <cols>   Number of  matrix columns (max %d)\n", MAXN);
     printf("Example: %s -M 8 -N 8\n", argv[0]);
@@ -201,7 +667,7 @@ int main(int argc, char* argv[])
 {
     char c;
 
-    while ((c = getopt(argc,argv,"M:N:h")) != -1) {
+    while ((c = getopt(argc,argv,"M:N:Lj:T:P:Ch")) != -1) {
         switch(c) {
         case 'M':
             M = atoi(optarg);
@@ -209,6 +675,21 @@ int main(int argc, char* argv[])
         case 'N':
             N = atoi(optarg);
             break;
+        case 'L':
+            use_lackey = 1;
+            break;
+        case 'j':
+            jobs = atoi(optarg);
+            break;
+        case 'T':
+            bench_reps = atoi(optarg);
+            break;
+        case 'P':
+            max_threads = atoi(optarg);
+            break;
+        case 'C':
+            counters = 1;
+            break;
         case 'h':
             usage(argv);
             exit(0);
@@ -230,6 +711,15 @@ int main(int argc, char* argv[])
         exit(1);
     }
 
+    if (bench_reps > MAXREPS) {
+        printf("Error: reps exceeds %d\n", MAXREPS);
+        usage(argv);
+        exit(1);
+    }
+
+    A = allocMatrix(N, M);
+    B = allocMatrix(M, N);
+
     /* Install SIGSEGV and SIGALRM handlers */
     if (signal(SIGSEGV, sigsegv_handler) == SIG_ERR) {
         fprintf(stderr, "Unable to install SIGALRM handler\n");
@@ -247,6 +737,20 @@ int main(int argc, char* argv[])
     /* Check the performance of the student's transpose function */
     eval_perf(5, 1, 5);
 
+    /* Time the native builds on the real caches */
+    if (bench_reps > 0) {
+        alarm(0);
+        eval_bench(bench_reps);
+    }
+    if (counters) {
+        alarm(0);
+        eval_counters();
+    }
+    if (max_threads > 0) {
+        alarm(0);
+        eval_threads(max_threads, bench_reps > 0 ? bench_reps : 10);
+    }
+
     /* Emit the results for this particular test */
     if (results.funcid == -1) {
         printf("\nError: We could not find your transpose_submit() function\n");
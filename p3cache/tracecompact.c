@@ -0,0 +1,101 @@
+/*
+ * tracecompact.c - Offline run-length compactor for valgrind lackey
+ * traces.
+ *
+ * Consecutive accesses to the same cache line are collapsed into one
+ * trace line carrying the number of accesses it stands for, e.g.
+ * " L 04f6b868,8*6". csim applies such a line as a single model update
+ * and reports exactly the same statistics as for the original trace,
+ * provided it is run with a block size of at least 2^b bytes.
+ *
+ * Instruction fetches and data accesses are collapsed independently,
+ * so an 'I' line in the middle of a data run does not break it.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include "cachelab.h"
+
+/*
+ * usage - Print usage info
+ */
+void usage(char *argv[]){
+    printf("Usage: %s [-h] -b <b> [-t <tracefile>] [-o <outfile>]\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h          Print this help message.\n");
+    printf("  -b <b>      Number of block offset bits to collapse runs on\n");
+    printf("  -t <file>   Trace to compact (default stdin)\n");
+    printf("  -o <file>   Compacted trace (default stdout)\n");
+    printf("Example: %s -b 5 -t traces/long.trace -o long.rle\n", argv[0]);
+}
+
+int main(int argc, char* argv[])
+{
+    char c, op;
+    char buf[256];
+    int b = -1, size;
+    unsigned int count;
+    unsigned long addr;
+    FILE *in_fp = stdin;
+    FILE *out_fp = stdout;
+    run_filter_t data_filter, instr_filter;
+    trace_run_t run;
+
+    while ((c = getopt(argc, argv, "b:t:o:h")) != -1) {
+        switch (c) {
+        case 'b':
+            b = atoi(optarg);
+            break;
+        case 't':
+            if ((in_fp = fopen(optarg, "r")) == NULL) {
+                printf("Error: Unable to open %s\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'o':
+            if ((out_fp = fopen(optarg, "w")) == NULL) {
+                printf("Error: Unable to open %s\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+
+    if (b < 0) {
+        printf("Error: Missing required argument\n");
+        usage(argv);
+        exit(1);
+    }
+
+    runFilterInit(&data_filter, b);
+    runFilterInit(&instr_filter, b);
+    while (fgets(buf, sizeof(buf), in_fp) != NULL) {
+        if (!parseTraceLine(buf, &op, &addr, &size, &count))
+            continue;
+        if (op == 'I') {
+            if (runFilterPush(&instr_filter, op, addr, size, count, &run))
+                printTraceRun(out_fp, &run);
+        } else {
+            if (runFilterPush(&data_filter, op, addr, size, count, &run))
+                printTraceRun(out_fp, &run);
+        }
+    }
+    if (runFilterFlush(&instr_filter, &run))
+        printTraceRun(out_fp, &run);
+    if (runFilterFlush(&data_filter, &run))
+        printTraceRun(out_fp, &run);
+
+    fprintf(stderr, "data accesses:%lu runs:%lu, instruction fetches:%lu runs:%lu\n",
+            data_filter.accesses, data_filter.runs,
+            instr_filter.accesses, instr_filter.runs);
+
+    fclose(in_fp);
+    fclose(out_fp);
+    return 0;
+}
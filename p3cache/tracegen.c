@@ -3,10 +3,15 @@
  * a memory trace of all of the registered transpose functions.
  *
  * The beginning and end of each registered transpose function's trace
- * is indicated by reading from "marker" addresses. These two marker
- * addresses are recorded in file for later use.
+ * is indicated by writing to "marker" addresses. With -m, these two
+ * marker addresses are printed as "MARKERS <start> <end>" on stdout,
+ * ahead of the trace, so test-trans can read both from one pipe.
+ *
+ * Each function runs on a stack of its own, so -m can also print the
+ * exact extents of A, B and that stack as "REGION <name> <lo> <hi>"
+ * lines. test-trans keeps only the accesses that fall in them.
  */
-
+#define _XOPEN_SOURCE 600 /* for the ucontext functions under -std=c99 */
 #include <stdlib.h>
 #include <stdio.h>
 #include <assert.h>
@@ -14,6 +19,7 @@
 #include <getopt.h>
 #include "cachelab.h"
 #include <string.h>
+#include <ucontext.h>
 
 /* External variables declared in cachelab.c */
 extern trans_func_t func_list[MAX_TRANS_FUNCS];
@@ -25,20 +31,25 @@ extern void registerFunctions();
 /* Markers used to bound trace regions of interest */
 volatile char MARKER_START, MARKER_END;
 
-static int A[256][256];
-static int B[256][256];
+/* Heap allocated, page aligned so that test-trans can reproduce the
+   set mapping */
+static int *A;
+static int *B;
 static int M;
 static int N;
 
+/* The stack the transpose functions run on, and the function to run */
+#define FUNC_STACK_SIZE (1 << 20)
+static char *func_stack;
+static ucontext_t main_ctx, func_ctx;
+static int current_func;
+
 
 int validate(int fn,int M, int N, int A[N][M], int B[M][N]) {
-    int C[M][N];
-    memset(C,0,sizeof(C));
-    correctTrans(M,N,A,C);
     for(int i=0;i<M;i++) {
         for(int j=0;j<N;j++) {
-            if(B[i][j]!=C[i][j]) {
-                printf("Validation failed on function %d! Expected %d but got %d at B[%d][%d]\n",fn,C[i][j],B[i][j],i,j);
+            if(B[i][j]!=A[j][i]) {
+                printf("Validation failed on function %d! Expected %d but got %d at B[%d][%d]\n",fn,A[j][i],B[i][j],i,j);
                 return 0;
             }
         }
@@ -46,13 +57,48 @@ int validate(int fn,int M, int N, int A[N][M], int B[M][N]) {
     return 1;
 }
 
+/*
+ * run_marked - Body of func_ctx: call the current function between the
+ *     two markers
+ */
+static void run_marked(void)
+{
+    MARKER_START = 33;
+    (*func_list[current_func].func_ptr)(M, N, (int (*)[M])A, (int (*)[N])B);
+    MARKER_END = 34;
+}
+
+/*
+ * run_func - Run function i on func_stack
+ */
+static void run_func(int i)
+{
+    current_func = i;
+    if (getcontext(&func_ctx) < 0) {
+        perror("getcontext");
+        exit(1);
+    }
+    func_ctx.uc_stack.ss_sp = func_stack;
+    func_ctx.uc_stack.ss_size = FUNC_STACK_SIZE;
+    func_ctx.uc_link = &main_ctx;
+    makecontext(&func_ctx, run_marked, 0);
+    if (swapcontext(&main_ctx, &func_ctx) < 0) {
+        perror("swapcontext");
+        exit(1);
+    }
+}
+
 int main(int argc, char* argv[]){
     int i;
 
     char c;
     int selectedFunc=-1;
-    while( (c=getopt(argc,argv,"M:N:F:")) != -1){
+    int print_markers=0;
+    while( (c=getopt(argc,argv,"M:N:F:m")) != -1){
         switch(c){
+        case 'm':
+            print_markers = 1;
+            break;
         case 'M':
             M = atoi(optarg);
             break;
@@ -74,30 +120,40 @@ int main(int argc, char* argv[]){
     registerFunctions();
 
     /* Fill A with data */
-    initMatrix(M,N, A, B);
+    A = allocMatrix(N, M);
+    B = allocMatrix(M, N);
+    int (*a)[M] = (int (*)[M])A;
+    int (*b)[N] = (int (*)[N])B;
+    initMatrix(M,N, a, b);
+    if ((func_stack = malloc(FUNC_STACK_SIZE)) == NULL) {
+        printf("./tracegen failed to allocate a stack.\n");
+        exit(1);
+    }
 
-    /* Record marker addresses */
-    FILE* marker_fp = fopen(".marker","w");
-    assert(marker_fp);
-    fprintf(marker_fp, "%llx %llx",
-            (unsigned long long int) &MARKER_START,
-            (unsigned long long int) &MARKER_END );
-    fclose(marker_fp);
+    /* Report markers and regions; flush so they precede the trace */
+    if (print_markers) {
+        printf("REGION A %lx %lx\n", (unsigned long)A,
+               (unsigned long)(A + (size_t)M * N));
+        printf("REGION B %lx %lx\n", (unsigned long)B,
+               (unsigned long)(B + (size_t)M * N));
+        printf("REGION stack %lx %lx\n", (unsigned long)func_stack,
+               (unsigned long)(func_stack + FUNC_STACK_SIZE));
+        printf("MARKERS %llx %llx\n",
+               (unsigned long long int) &MARKER_START,
+               (unsigned long long int) &MARKER_END );
+        fflush(stdout);
+    }
 
     if (-1==selectedFunc) {
         /* Invoke registered transpose functions */
         for (i=0; i < func_counter; i++) {
-            MARKER_START = 33;
-            (*func_list[i].func_ptr)(M, N, A, B);
-            MARKER_END = 34;
-            if (!validate(i,M,N,A,B))
+            run_func(i);
+            if (!validate(i,M,N,a,b))
                 return i+1;
         }
     } else {
-        MARKER_START = 33;
-        (*func_list[selectedFunc].func_ptr)(M, N, A, B);
-        MARKER_END = 34;
-        if (!validate(selectedFunc,M,N,A,B))
+        run_func(selectedFunc);
+        if (!validate(selectedFunc,M,N,a,b))
             return selectedFunc+1;
 
     }
@@ -0,0 +1,124 @@
+/*
+ * trans-tuned.c - Transpose kernels generated by
+ *     ./autotune -s 5 -E 1 -b 5 -S 32x32 -S 64x64 -S 61x67 -o trans-tuned.c
+ *
+ * Tuned for a cache with s=5, E=1, b=5. Do not edit by hand;
+ * rerun autotune instead.
+ */
+#include "cachelab.h"
+
+/* 32x32: 1x8 tiles, order=1 inner=0 diag=1 buf=0, 284 misses */
+static void tuned_32x32(int M, int N, int A[N][M], int B[M][N])
+{
+    int ii, jj, i, j;
+    int tmp = 0, d = 0;
+
+    for (jj = 0; jj < M; jj += 8) {
+        for (ii = 0; ii < N; ii += 1) {
+            for (i = ii; i < ii + 1 && i < N; i++) {
+                for (j = jj; j < jj + 8 && j < M; j++) {
+                    if (i == j) {
+                        tmp = LOAD(A[i][j]);
+                        d = 1;
+                        continue;
+                    }
+                    STORE(B[j][i], LOAD(A[i][j]));
+                }
+                if (d) {
+                    STORE(B[i][i], tmp);
+                    d = 0;
+                }
+            }
+        }
+    }
+}
+
+/* 64x64: 1x4 tiles, order=1 inner=0 diag=0 buf=1, 1648 misses */
+static void tuned_64x64(int M, int N, int A[N][M], int B[M][N])
+{
+    int ii, jj, i, j;
+    int t0, t1, t2, t3;
+
+    for (jj = 0; jj < M; jj += 4) {
+        for (ii = 0; ii < N; ii += 1) {
+            for (i = ii; i < ii + 1 && i < N; i++) {
+                if (jj + 4 <= M) {
+                    t0 = LOAD(A[i][jj+0]);
+                    t1 = LOAD(A[i][jj+1]);
+                    t2 = LOAD(A[i][jj+2]);
+                    t3 = LOAD(A[i][jj+3]);
+                    STORE(B[jj+0][i], t0);
+                    STORE(B[jj+1][i], t1);
+                    STORE(B[jj+2][i], t2);
+                    STORE(B[jj+3][i], t3);
+                    continue;
+                }
+                for (j = jj; j < jj + 4 && j < M; j++) {
+                    STORE(B[j][i], LOAD(A[i][j]));
+                }
+            }
+        }
+    }
+}
+
+/* 61x67: 17x4 tiles, order=0 inner=0 diag=0 buf=1, 1708 misses */
+static void tuned_61x67(int M, int N, int A[N][M], int B[M][N])
+{
+    int ii, jj, i, j;
+    int t0, t1, t2, t3;
+
+    for (ii = 0; ii < N; ii += 17) {
+        for (jj = 0; jj < M; jj += 4) {
+            for (i = ii; i < ii + 17 && i < N; i++) {
+                if (jj + 4 <= M) {
+                    t0 = LOAD(A[i][jj+0]);
+                    t1 = LOAD(A[i][jj+1]);
+                    t2 = LOAD(A[i][jj+2]);
+                    t3 = LOAD(A[i][jj+3]);
+                    STORE(B[jj+0][i], t0);
+                    STORE(B[jj+1][i], t1);
+                    STORE(B[jj+2][i], t2);
+                    STORE(B[jj+3][i], t3);
+                    continue;
+                }
+                for (j = jj; j < jj + 4 && j < M; j++) {
+                    STORE(B[j][i], LOAD(A[i][j]));
+                }
+            }
+        }
+    }
+}
+
+/*
+ * transpose_tuned - Dispatch to the kernel tuned for this shape, or
+ *     fall back to a row-wise scan for shapes that were not tuned
+ */
+static char transpose_tuned_desc[] = "Autotuned transpose";
+static void transpose_tuned(int M, int N, int A[N][M], int B[M][N])
+{
+    int i, j;
+
+    if (M == 32 && N == 32) {
+        tuned_32x32(M, N, A, B);
+        return;
+    }
+    if (M == 64 && N == 64) {
+        tuned_64x64(M, N, A, B);
+        return;
+    }
+    if (M == 61 && N == 67) {
+        tuned_61x67(M, N, A, B);
+        return;
+    }
+    for (i = 0; i < N; i++)
+        for (j = 0; j < M; j++)
+            STORE(B[j][i], LOAD(A[i][j]));
+}
+
+/*
+ * registerTunedFunctions - Called from registerFunctions() in trans.c
+ */
+void registerTunedFunctions()
+{
+    registerTransFunction(transpose_tuned, transpose_tuned_desc);
+}
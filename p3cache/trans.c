@@ -6,11 +6,24 @@
  *
  * A transpose function is evaluated by counting the number of misses
  * on a 1KB direct mapped cache with a block size of 32 bytes.
+ *
+ * Access A and B through LOAD() and STORE() from cachelab.h so that
+ * test-trans can trace the function in-process, and keep everything
+ * but registerFunctions() static: test-trans links a traced and a
+ * native build of this file side by side.
  */
 #include <stdio.h>
 #include "cachelab.h"
 
-int is_transpose(int M, int N, int A[N][M], int B[M][N]);
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+static int is_transpose(int M, int N, int A[N][M], int B[M][N])
+    __attribute__((unused));
+
+/* Defined in the autotune-generated trans-tuned.c */
+extern void registerTunedFunctions();
 
 /*
  * transpose_submit - This is the solution transpose function that you
@@ -19,10 +32,10 @@ int is_transpose(int M, int N, int A[N][M], int B[M][N]);
  *     searches for that string to identify the transpose function to
  *     be graded.
  */
-char transpose_submit_desc[] = "Transpose submission";
-void transpose_submit(int M, int N, int A[N][M], int B[M][N])
+static char transpose_submit_desc[] = "Transpose submission";
+static void transpose_submit(int M, int N, int A[N][M], int B[M][N])
 {
-    int r, c, temp, index;
+    int r, c, temp = 0, index = 0;
     int row, col;
 
     if (N == 32)
@@ -32,14 +45,14 @@ void transpose_submit(int M, int N, int A[N][M], int B[M][N])
                 for (r = row; r < row+8; r++){
                     for (c = col; c < col+8; c++){
                         if (c != r) 
-                            B[c][r] = A[r][c];
+                            STORE(B[c][r], LOAD(A[r][c]));
                         else {
-                            temp = A[r][c];
+                            temp = LOAD(A[r][c]);
                             index = r;
                         }
                     }
                     if (col == row)
-                        B[index][index] = temp;
+                        STORE(B[index][index], temp);
                 }
             }
     } else if ((M == 32) & (N == 64)) {
@@ -47,8 +60,8 @@ void transpose_submit(int M, int N, int A[N][M], int B[M][N])
             for (col=0; col<32; col+=4)
                 for (r = row; r<row+8; r++){
                     for (c = col; c<col+4; c++){
-                        temp = A[r][c];
-                        B[c][r] = temp;
+                        temp = LOAD(A[r][c]);
+                        STORE(B[c][r], temp);
                     }
                 }
     } else {
@@ -57,14 +70,14 @@ void transpose_submit(int M, int N, int A[N][M], int B[M][N])
                 for (c = col; c < col+4; c++){
                     for (r = row; r < row+4; r++){
                         if (c != r)
-                            B[c][r] = A[r][c];
+                            STORE(B[c][r], LOAD(A[r][c]));
                         else {
-                            temp = A[r][c];
+                            temp = LOAD(A[r][c]);
                             index = r;
                         }
                     }
                     if (col == row)
-                        B[index][index] = temp;
+                        STORE(B[index][index], temp);
                 }
             }
         }
@@ -79,19 +92,161 @@ void transpose_submit(int M, int N, int A[N][M], int B[M][N])
 /*
  * trans - A simple baseline transpose function, not optimized for the cache.
  */
-char trans_desc[] = "Simple row-wise scan transpose";
-void trans(int M, int N, int A[N][M], int B[M][N])
+static char trans_desc[] = "Simple row-wise scan transpose";
+static void trans(int M, int N, int A[N][M], int B[M][N])
 {
     int i, j, tmp;
 
     for (i = 0; i < N; i++) {
         for (j = 0; j < M; j++) {
-            tmp = A[i][j];
-            B[j][i] = tmp;
+            tmp = LOAD(A[i][j]);
+            STORE(B[j][i], tmp);
+        }
+    }
+
+}
+
+/*
+ * trans_co - Cache-oblivious transpose: halve the longer side of the
+ *     block until it holds at most CO_CUTOFF elements, then copy it
+ *     row-wise. Sub-blocks eventually fit in every level of the cache,
+ *     whatever its geometry. Simulating 64x64 up to 1024x1024 on caches
+ *     from 1KB direct-mapped to 256KB 16-way, cutoffs up to 16 stayed
+ *     within a few percent of the compulsory misses while 32 and above
+ *     lost up to 10x on L1-sized caches.
+ */
+#define CO_CUTOFF 16
+
+static void trans_co_block(int M, int N, int A[N][M], int B[M][N],
+                           int i0, int i1, int j0, int j1)
+{
+    int i, j, mid;
+
+    if ((i1 - i0) * (j1 - j0) <= CO_CUTOFF) {
+        for (i = i0; i < i1; i++)
+            for (j = j0; j < j1; j++)
+                STORE(B[j][i], LOAD(A[i][j]));
+    } else if (i1 - i0 >= j1 - j0) {
+        mid = i0 + (i1 - i0) / 2;
+        trans_co_block(M, N, A, B, i0, mid, j0, j1);
+        trans_co_block(M, N, A, B, mid, i1, j0, j1);
+    } else {
+        mid = j0 + (j1 - j0) / 2;
+        trans_co_block(M, N, A, B, i0, i1, j0, mid);
+        trans_co_block(M, N, A, B, i0, i1, mid, j1);
+    }
+}
+
+static char trans_co_desc[] = "Cache-oblivious recursive transpose";
+static void trans_co(int M, int N, int A[N][M], int B[M][N])
+{
+    trans_co_block(M, N, A, B, 0, N, 0, M);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/*
+ * trans_edges - Scalar transpose of the rows from i0 on and of the
+ *     columns from j0 on, which the vector kernels below leave over
+ */
+static void trans_edges(int M, int N, int A[N][M], int B[M][N], int i0, int j0)
+{
+    int i, j;
+
+    for (i = 0; i < i0; i++)
+        for (j = j0; j < M; j++)
+            STORE(B[j][i], LOAD(A[i][j]));
+    for (i = i0; i < N; i++)
+        for (j = 0; j < M; j++)
+            STORE(B[j][i], LOAD(A[i][j]));
+}
+
+/*
+ * trans_sse - Transpose 4x4 blocks in SSE registers: two rounds of
+ *     unpacks turn four rows of A into four rows of B
+ */
+static char trans_sse_desc[] = "SSE 4x4 in-register transpose";
+__attribute__((target("sse2")))
+static void trans_sse(int M, int N, int A[N][M], int B[M][N])
+{
+    int i, j;
+    __m128i r0, r1, r2, r3, t0, t1, t2, t3;
+
+    for (i = 0; i + 4 <= N; i += 4) {
+        for (j = 0; j + 4 <= M; j += 4) {
+            r0 = _mm_loadu_si128(LOAD_PTR(&A[i+0][j], 16));
+            r1 = _mm_loadu_si128(LOAD_PTR(&A[i+1][j], 16));
+            r2 = _mm_loadu_si128(LOAD_PTR(&A[i+2][j], 16));
+            r3 = _mm_loadu_si128(LOAD_PTR(&A[i+3][j], 16));
+
+            t0 = _mm_unpacklo_epi32(r0, r1);    /* a0 b0 a1 b1 */
+            t1 = _mm_unpacklo_epi32(r2, r3);    /* c0 d0 c1 d1 */
+            t2 = _mm_unpackhi_epi32(r0, r1);    /* a2 b2 a3 b3 */
+            t3 = _mm_unpackhi_epi32(r2, r3);    /* c2 d2 c3 d3 */
+
+            _mm_storeu_si128(STORE_PTR(&B[j+0][i], 16), _mm_unpacklo_epi64(t0, t1));
+            _mm_storeu_si128(STORE_PTR(&B[j+1][i], 16), _mm_unpackhi_epi64(t0, t1));
+            _mm_storeu_si128(STORE_PTR(&B[j+2][i], 16), _mm_unpacklo_epi64(t2, t3));
+            _mm_storeu_si128(STORE_PTR(&B[j+3][i], 16), _mm_unpackhi_epi64(t2, t3));
         }
     }
+    trans_edges(M, N, A, B, N & ~3, M & ~3);
+}
 
+/*
+ * trans_avx2 - Transpose 8x8 blocks in AVX2 registers: 32-bit and
+ *     64-bit unpacks transpose the 4x4 quarters within each 128-bit
+ *     lane, then a 128-bit lane permute swaps the off-diagonal quarters
+ */
+static char trans_avx2_desc[] = "AVX2 8x8 in-register transpose";
+__attribute__((target("avx2")))
+static void trans_avx2(int M, int N, int A[N][M], int B[M][N])
+{
+    int i, j;
+    __m256i r0, r1, r2, r3, r4, r5, r6, r7;
+    __m256i t0, t1, t2, t3, t4, t5, t6, t7;
+
+    for (i = 0; i + 8 <= N; i += 8) {
+        for (j = 0; j + 8 <= M; j += 8) {
+            r0 = _mm256_loadu_si256(LOAD_PTR(&A[i+0][j], 32));
+            r1 = _mm256_loadu_si256(LOAD_PTR(&A[i+1][j], 32));
+            r2 = _mm256_loadu_si256(LOAD_PTR(&A[i+2][j], 32));
+            r3 = _mm256_loadu_si256(LOAD_PTR(&A[i+3][j], 32));
+            r4 = _mm256_loadu_si256(LOAD_PTR(&A[i+4][j], 32));
+            r5 = _mm256_loadu_si256(LOAD_PTR(&A[i+5][j], 32));
+            r6 = _mm256_loadu_si256(LOAD_PTR(&A[i+6][j], 32));
+            r7 = _mm256_loadu_si256(LOAD_PTR(&A[i+7][j], 32));
+
+            t0 = _mm256_unpacklo_epi32(r0, r1); /* a0 b0 a1 b1 | a4 b4 a5 b5 */
+            t1 = _mm256_unpackhi_epi32(r0, r1); /* a2 b2 a3 b3 | a6 b6 a7 b7 */
+            t2 = _mm256_unpacklo_epi32(r2, r3);
+            t3 = _mm256_unpackhi_epi32(r2, r3);
+            t4 = _mm256_unpacklo_epi32(r4, r5);
+            t5 = _mm256_unpackhi_epi32(r4, r5);
+            t6 = _mm256_unpacklo_epi32(r6, r7);
+            t7 = _mm256_unpackhi_epi32(r6, r7);
+
+            r0 = _mm256_unpacklo_epi64(t0, t2); /* a0 b0 c0 d0 | a4 b4 c4 d4 */
+            r1 = _mm256_unpackhi_epi64(t0, t2); /* a1 b1 c1 d1 | a5 b5 c5 d5 */
+            r2 = _mm256_unpacklo_epi64(t1, t3);
+            r3 = _mm256_unpackhi_epi64(t1, t3);
+            r4 = _mm256_unpacklo_epi64(t4, t6); /* e0 f0 g0 h0 | e4 f4 g4 h4 */
+            r5 = _mm256_unpackhi_epi64(t4, t6);
+            r6 = _mm256_unpacklo_epi64(t5, t7);
+            r7 = _mm256_unpackhi_epi64(t5, t7);
+
+            _mm256_storeu_si256(STORE_PTR(&B[j+0][i], 32), _mm256_permute2x128_si256(r0, r4, 0x20));
+            _mm256_storeu_si256(STORE_PTR(&B[j+1][i], 32), _mm256_permute2x128_si256(r1, r5, 0x20));
+            _mm256_storeu_si256(STORE_PTR(&B[j+2][i], 32), _mm256_permute2x128_si256(r2, r6, 0x20));
+            _mm256_storeu_si256(STORE_PTR(&B[j+3][i], 32), _mm256_permute2x128_si256(r3, r7, 0x20));
+            _mm256_storeu_si256(STORE_PTR(&B[j+4][i], 32), _mm256_permute2x128_si256(r0, r4, 0x31));
+            _mm256_storeu_si256(STORE_PTR(&B[j+5][i], 32), _mm256_permute2x128_si256(r1, r5, 0x31));
+            _mm256_storeu_si256(STORE_PTR(&B[j+6][i], 32), _mm256_permute2x128_si256(r2, r6, 0x31));
+            _mm256_storeu_si256(STORE_PTR(&B[j+7][i], 32), _mm256_permute2x128_si256(r3, r7, 0x31));
+        }
+    }
+    trans_edges(M, N, A, B, N & ~7, M & ~7);
 }
+#endif
 
 /*
  * registerFunctions - This function registers your transpose
@@ -107,6 +262,16 @@ void registerFunctions()
 
     /* Register any additional transpose functions */
     registerTransFunction(trans, trans_desc);
+    registerTransFunction(trans_co, trans_co_desc);
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("sse2"))
+        registerTransFunction(trans_sse, trans_sse_desc);
+    if (__builtin_cpu_supports("avx2"))
+        registerTransFunction(trans_avx2, trans_avx2_desc);
+#endif
+
+    /* Register the kernels tuned by autotune */
+    registerTunedFunctions();
 
 }
 
@@ -115,7 +280,7 @@ void registerFunctions()
  *     A. You can check the correctness of your transpose by calling
  *     it before returning from the transpose function.
  */
-int is_transpose(int M, int N, int A[N][M], int B[M][N])
+static int is_transpose(int M, int N, int A[N][M], int B[M][N])
 {
     int i, j;
 
@@ -62,9 +62,19 @@
 #define ALIGNMENT 8
 
 /*
- * Maximum heap size in bytes
+ * Maximum heap size in bytes. This much address space is reserved up
+ * front; memory is only committed as the break reaches it.
  */
-#define MAX_HEAP (20*(1<<20))  /* 20 MB */
+#define MAX_HEAP (32UL << 30)  /* 32 GB */
+#define COMMIT_STEP (1 << 21)  /* commit the heap a huge page at a time */
+
+/*
+ * Back the heap with transparent huge pages (1) or 4 KB pages (0).
+ * The heap starts on a HUGE_SIZE boundary either way; mdriver -H
+ * times every trace both ways.
+ */
+#define HUGE_PAGES 1
+#define HUGE_SIZE (1 << 21)    /* 2 MB */
 
 #define AUTOGRADE_TIMEOUT 360
 
@@ -26,6 +26,7 @@
 #include "mm.h"
 #include "memlib.h"
 #include "fsecs.h"
+#include "perfctr.h"
 #include "config.h"
 
 /**********************
@@ -59,10 +60,17 @@ typedef struct range_t {
 	int index;             /* same index as free; for debugging */
 } range_t;
 
-/* Characterizes a single trace operation (allocator request) */
+/*
+ * Characterizes a single trace operation (allocator request). Besides
+ * "a <index> <size>", "r <index> <size>" and "f <index>", a trace may
+ * hold "A <index> <count> <size>" and "F <index> <count>", which
+ * allocate and free blocks index..index+count-1 with mm_malloc_batch
+ * and mm_free_batch, and "s <index>", which frees with mm_free_sized.
+ */
 typedef struct {
-	enum { ALLOC, FREE, REALLOC } type; /* type of request */
+	enum { ALLOC, FREE, REALLOC, BATCH_ALLOC, BATCH_FREE, SIZED_FREE } type;
 	int index;                        /* index for free() to use later */
+	int count;                        /* blocks of a batch */
 	size_t size;                      /* byte size of alloc/realloc request */
 } traceop_t;
 
@@ -72,11 +80,13 @@ typedef struct {
 	int ignore_ranges;   /* don't check ranges (i.e. this is too big) */
 	int num_ids;         /* number of alloc/realloc ids */
 	int num_ops;         /* number of distinct requests */
+	int num_blocks;      /* ... counting every block of a batch */
 	int weight;          /* weight for this trace (unused) */
 	traceop_t *ops;      /* array of requests */
 	char **blocks;       /* array of ptrs returned by malloc/realloc... */
 	size_t *block_sizes; /* ... and a corresponding array of payload sizes */
 	int *block_rand_base;/* index into random_data, if debug is on */
+	void **batch;        /* the blocks of a batch op */
 } trace_t;
 
 /*
@@ -104,6 +114,12 @@ typedef struct {
 	double util;     /* space utilization for this trace (always 0 for libc) */
 
 	/* Note: secs and util are only defined if valid is true */
+
+	perf_sample_t perf; /* hardware counters over one run, with -p */
+	double page_secs[2]; /* secs on 4 KB pages, on huge pages, with -H */
+	int peak_op;         /* op after which the most payload was live */
+	mm_stats_t at_peak;  /* allocator statistics then ... */
+	mm_stats_t at_end;   /* ... and after the last op, with -S */
 } stats_t;
 
 
@@ -159,6 +175,9 @@ int onetime_flag = 0;
 
 /* by default, no timeouts */
 static int set_timeout = 0;
+static int use_perf = 0;  /* also read hardware counters (set by -p) */
+static int cmp_huge = 0;  /* also time with and without huge pages (set by -H) */
+static int show_stats = 0; /* also dump allocator statistics (set by -S) */
 
 
 /* Directory where default tracefiles are found */
@@ -197,11 +216,15 @@ static void eval_libc_speed(void *ptr);
 /* Routines for evaluating correctnes, space utilization, and speed
    of the student's malloc package in mm.c */
 static int eval_mm_valid(trace_t *trace, range_t **ranges);
-static double eval_mm_util(trace_t *trace, int tracenum);
+static double eval_mm_util(trace_t *trace, int tracenum, int *peak_op);
 static void eval_mm_speed(void *ptr);
+static void eval_mm_stats(trace_t *trace, stats_t *stats);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
+static void printperf(int n, stats_t *stats);
+static void printhuge(int n, stats_t *stats);
+static void printstats(int n, stats_t *stats);
 static void usage(void);
 static void malloc_error(const trace_t *trace, int opnum, const char *fmt, ...)
 	__attribute__((format(printf, 3,4)));
@@ -224,6 +247,7 @@ static void run_tests(int num_tracefiles, const char *tracedir,
 		stats_t *mm_stats, range_t *ranges, speed_t *speed_params) {
 	volatile int i;
 	volatile int timed_out = 0;
+	int h;
 
 	for (i=0; i < num_tracefiles; i++) {
 		/* handle timeouts */
@@ -234,7 +258,7 @@ static void run_tests(int num_tracefiles, const char *tracedir,
 		trace_t *trace;
 		trace = read_trace(&mm_stats[i], tracedir, tracefiles[i]);
 		strcpy(mm_stats[i].filename, trace->filename);
-		mm_stats[i].ops = trace->num_ops;
+		mm_stats[i].ops = trace->num_blocks;
 		if(timed_out) {
 			mm_stats[i].valid = 0;
 		} else {
@@ -250,12 +274,25 @@ static void run_tests(int num_tracefiles, const char *tracedir,
 		if (mm_stats[i].valid) {
 			if (verbose > 1)
 				printf("efficiency, ");
-			mm_stats[i].util = eval_mm_util(trace, i);
+			mm_stats[i].util = eval_mm_util(trace, i, &mm_stats[i].peak_op);
 			speed_params->trace = trace;
 			speed_params->ranges = ranges;
 			if (verbose > 1)
 				printf("and performance.\n");
 			mm_stats[i].secs = fsecs(eval_mm_speed, speed_params);
+			if (use_perf)
+				perf_measure(eval_mm_speed, speed_params, &mm_stats[i].perf);
+			if (cmp_huge) {
+				for (h = 0; h < 2; h++) {
+					if (mem_set_hugepages(h) < 0)
+						mm_stats[i].page_secs[h] = 0;
+					else
+						mm_stats[i].page_secs[h] = fsecs(eval_mm_speed, speed_params);
+				}
+				mem_set_hugepages(HUGE_PAGES);
+			}
+			if (show_stats)
+				eval_mm_stats(trace, &mm_stats[i]);
 		}
 		free_trace(trace);
 	}
@@ -291,7 +328,7 @@ int main(int argc, char **argv)
 	/*
 	 * Read and interpret the command line arguments
 	 */
-	while ((c = getopt(argc, argv, "d:f:c:s:t:v:hVAlD")) != EOF) {
+	while ((c = getopt(argc, argv, "d:f:c:s:t:v:hVAlDpHS")) != EOF) {
 		switch (c) {
 
 			case 'A': /* Hidden Autolab driver argument */
@@ -349,6 +386,18 @@ int main(int argc, char **argv)
 				set_timeout = atoi(optarg);
 				break;
 
+			case 'p': /* Read hardware counters too */
+				use_perf = 1;
+				break;
+
+			case 'H': /* Time with and without huge pages too */
+				cmp_huge = 1;
+				break;
+
+			case 'S': /* Dump allocator statistics too */
+				show_stats = 1;
+				break;
+
 			case 'h': /* Print this message */
 				usage();
 				exit(0);
@@ -371,6 +420,9 @@ int main(int argc, char **argv)
 
 	/* Initialize the timing package */
 	init_fsecs();
+	if (use_perf && perf_init() < PERF_NCOUNTERS)
+		printf("Hardware counters: %s; the rest is software clock only.\n",
+				perf_status());
 
 	/* Initialize the timeout */
 	if (set_timeout) {
@@ -402,6 +454,8 @@ int main(int argc, char **argv)
 				if (verbose > 1)
 					printf("and performance.\n");
 				libc_stats[i].secs = fsecs(eval_libc_speed, &speed_params);
+				if (use_perf)
+					perf_measure(eval_libc_speed, &speed_params, &libc_stats[i].perf);
 			}
 			free_trace(trace);
 		}
@@ -410,6 +464,8 @@ int main(int argc, char **argv)
 		if (verbose) {
 			printf("\nResults for libc malloc:\n");
 			printresults(num_tracefiles, libc_stats);
+			if (use_perf)
+				printperf(num_tracefiles, libc_stats);
 		}
 	}
 
@@ -443,6 +499,12 @@ int main(int argc, char **argv)
 		} else {
 			printf("\nResults for mm malloc:\n");
 			printresults(num_tracefiles, mm_stats);
+			if (use_perf)
+				printperf(num_tracefiles, mm_stats);
+			if (cmp_huge)
+				printhuge(num_tracefiles, mm_stats);
+			if (show_stats)
+				printstats(num_tracefiles, mm_stats);
 			printf("\n");
 		}
 	}
@@ -550,9 +612,11 @@ static int add_range(range_t **ranges, char *lo, int size,
 		return 0;
 	}
 
-	/* The payload must lie within the extent of the heap */
-	if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) ||
-			(hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) {
+	/* The payload must lie within the extent of the heap, or of a
+	   mapping the allocator got from mem_map */
+	if (((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) ||
+			(hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) &&
+			!mem_is_mapped(lo, hi)) {
 		malloc_error(trace, opnum,
 				"Payload (%p:%p) lies outside heap (%p:%p)",
 				lo, hi, mem_heap_lo(), mem_heap_hi());
@@ -700,7 +764,7 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
 	FILE *tracefile;
 	trace_t *trace;
 	char type[MAXLINE];
-	int index, size;
+	int index, size, count;
 	int max_index = 0;
 	int op_index;
 
@@ -749,17 +813,24 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
 				calloc(trace->num_ids, sizeof(*trace->block_rand_base))) == NULL)
 		unix_error("malloc 5 failed in read_trace");
 
+	/* and room for the largest batch */
+	if ((trace->batch = calloc(trace->num_ids, sizeof(void *))) == NULL)
+		unix_error("malloc 6 failed in read_trace");
 
 	/* read every request line in the trace file */
 	index = 0;
 	op_index = 0;
+	trace->num_blocks = 0;
 	while (fscanf(tracefile, "%s", type) != EOF) {
+		trace->ops[op_index].count = 1;
 		switch(type[0]) {
 			case 'a':
 				assert(2 == fscanf(tracefile, "%u %u", &index, &size));
 				trace->ops[op_index].type = ALLOC;
 				trace->ops[op_index].index = index;
 				trace->ops[op_index].size = size;
+				assert(index < trace->num_ids);
+				trace->block_sizes[index] = size;
 				max_index = (index > max_index) ? index : max_index;
 				break;
 			case 'r':
@@ -767,6 +838,8 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
 				trace->ops[op_index].type = REALLOC;
 				trace->ops[op_index].index = index;
 				trace->ops[op_index].size = size;
+				assert(index < trace->num_ids);
+				trace->block_sizes[index] = size;
 				max_index = (index > max_index) ? index : max_index;
 				break;
 			case 'f':
@@ -774,10 +847,35 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
 				trace->ops[op_index].type = FREE;
 				trace->ops[op_index].index = index;
 				break;
+			case 'A':
+				assert(3 == fscanf(tracefile, "%u %u %u", &index, &count, &size));
+				trace->ops[op_index].type = BATCH_ALLOC;
+				trace->ops[op_index].index = index;
+				trace->ops[op_index].count = count;
+				trace->ops[op_index].size = size;
+				max_index = (index + count - 1 > max_index) ? index + count - 1 : max_index;
+				assert(index + count <= trace->num_ids);
+				while (count-- > 0)
+					trace->block_sizes[index + count] = size;
+				break;
+			case 'F':
+				assert(2 == fscanf(tracefile, "%u %u", &index, &count));
+				trace->ops[op_index].type = BATCH_FREE;
+				trace->ops[op_index].index = index;
+				trace->ops[op_index].count = count;
+				break;
+			case 's':
+				assert(1 == fscanf(tracefile, "%u", &index));
+				trace->ops[op_index].type = SIZED_FREE;
+				trace->ops[op_index].index = index;
+				assert(index < trace->num_ids);
+				trace->ops[op_index].size = trace->block_sizes[index];
+				break;
 			default:
 				app_error("Bogus type character (%c) in tracefile %s\n",
 						type[0], trace->filename);
 		}
+		trace->num_blocks += trace->ops[op_index].count;
 		op_index++;
 		if(op_index == trace->num_ops) break;
 	}
@@ -788,7 +886,7 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
 	/* fill in the stats */
 	strcpy(stats->filename, trace->filename);
 	stats->weight = trace->weight;
-	stats->ops = trace->num_ops;
+	stats->ops = trace->num_blocks;
 
 	return trace;
 }
@@ -804,7 +902,7 @@ static void reinit_trace(trace_t *trace)
 }
 
 /*
- * free_trace - Free the trace record and the four arrays it points
+ * free_trace - Free the trace record and the five arrays it points
  *              to, all of which were allocated in read_trace().
  */
 static void free_trace(trace_t *trace)
@@ -813,6 +911,7 @@ static void free_trace(trace_t *trace)
 	free(trace->blocks);
 	free(trace->block_sizes);
 	free(trace->block_rand_base);
+	free(trace->batch);
 	free(trace);              /* and the trace record itself... */
 }
 
@@ -826,7 +925,7 @@ static void free_trace(trace_t *trace)
  */
 static int eval_mm_valid(trace_t *trace, range_t **ranges)
 {
-	int i;
+	int i, j, count;
 	int index;
 	size_t size;
 	char *newp;
@@ -942,6 +1041,40 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
 				mm_free(p);
 				break;
 
+			case BATCH_ALLOC: /* mm_malloc_batch */
+				count = trace->ops[i].count;
+				if (mm_malloc_batch(size, count, trace->batch) != count) {
+					malloc_error(trace, i, "mm_malloc_batch failed.");
+					return 0;
+				}
+				for (j = 0; j < count; j++) {
+					p = trace->batch[j];
+					if (add_range(ranges, p, size, trace, i, index + j) == 0)
+						return 0;
+					trace->blocks[index + j] = p;
+					trace->block_sizes[index + j] = size;
+					randomize_block(trace, index + j);
+				}
+				break;
+
+			case BATCH_FREE: /* mm_free_batch */
+				count = trace->ops[i].count;
+				for (j = 0; j < count; j++) {
+					check_index(trace, i, index + j);
+					p = trace->blocks[index + j];
+					remove_range(ranges, p);
+					trace->batch[j] = p;
+				}
+				mm_free_batch(trace->batch, count);
+				break;
+
+			case SIZED_FREE: /* mm_free_sized */
+				check_index(trace, i, index);
+				p = trace->blocks[index];
+				remove_range(ranges, p);
+				mm_free_sized(p, size);
+				break;
+
 			default:
 				app_error("Nonexistent request type in eval_mm_valid");
 		}
@@ -962,11 +1095,12 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
  *   doesn't allow the students to decrement the brk pointer, so brk
  *   is always the high water mark of the heap.
  *
- *   A higher number is better: 1 is optimal.
+ *   A higher number is better: 1 is optimal. The op that reached the
+ *   high water mark is left in *peak_op.
  */
-static double eval_mm_util(trace_t *trace, int tracenum)
+static double eval_mm_util(trace_t *trace, int tracenum, int *peak_op)
 {
-	int i;
+	int i, j, count;
 	int index;
 	int size, newsize, oldsize;
 	int max_total_size = 0;
@@ -1033,20 +1167,55 @@ static double eval_mm_util(trace_t *trace, int tracenum)
 				total_size -= size;
 				break;
 
+			case BATCH_ALLOC: /* mm_malloc_batch */
+				index = trace->ops[i].index;
+				count = trace->ops[i].count;
+				size = trace->ops[i].size;
+				if (mm_malloc_batch(size, count, trace->batch) != count)
+					app_error("trace %d: mm_malloc_batch failed in eval_mm_util",
+							tracenum);
+				for (j = 0; j < count; j++) {
+					trace->blocks[index + j] = trace->batch[j];
+					trace->block_sizes[index + j] = size;
+				}
+				total_size += size * count;
+				break;
+
+			case BATCH_FREE: /* mm_free_batch */
+				index = trace->ops[i].index;
+				count = trace->ops[i].count;
+				for (j = 0; j < count; j++) {
+					trace->batch[j] = trace->blocks[index + j];
+					total_size -= trace->block_sizes[index + j];
+				}
+				mm_free_batch(trace->batch, count);
+				break;
+
+			case SIZED_FREE: /* mm_free_sized */
+				index = trace->ops[i].index;
+				size = trace->ops[i].size;
+				mm_free_sized(trace->blocks[index], size);
+				total_size -= size;
+				break;
+
 			default:
 				app_error("trace %d: Nonexistent request type in eval_mm_util",
 						tracenum);
 		}
 
 		/* update the high-water mark */
-		max_total_size = (total_size > max_total_size) ?
-			total_size : max_total_size;
+		if (total_size > max_total_size) {
+			max_total_size = total_size;
+			*peak_op = i;
+		}
 	}
 
 	printf("max_total_size = %f\n", (double)max_total_size);
-	printf("mem_heapsize = %f\n", (double)mem_heapsize());
+	printf("mem_heapsize = %f\n", (double)mem_peak_heapsize());
 	
-	return ((double)max_total_size / (double)mem_heapsize());
+	/* The heap may have shrunk since; what it and the mappings
+	   took at most counts */
+	return ((double)max_total_size / (double)mem_peak_heapsize());
 }
 
 
@@ -1056,7 +1225,7 @@ static double eval_mm_util(trace_t *trace, int tracenum)
  */
 static void eval_mm_speed(void *ptr)
 {
-	int i, index, size, newsize;
+	int i, j, index, size, newsize, count;
 	char *p, *newp, *oldp, *block;
 	trace_t *trace = ((speed_t *)ptr)->trace;
 	reinit_trace(trace);
@@ -1097,6 +1266,29 @@ static void eval_mm_speed(void *ptr)
 				mm_free(block);
 				break;
 
+			case BATCH_ALLOC: /* mm_malloc_batch */
+				index = trace->ops[i].index;
+				count = trace->ops[i].count;
+				size = trace->ops[i].size;
+				if (mm_malloc_batch(size, count, trace->batch) != count)
+					app_error("mm_malloc_batch error in eval_mm_speed");
+				for (j = 0; j < count; j++)
+					trace->blocks[index + j] = trace->batch[j];
+				break;
+
+			case BATCH_FREE: /* mm_free_batch */
+				index = trace->ops[i].index;
+				count = trace->ops[i].count;
+				for (j = 0; j < count; j++)
+					trace->batch[j] = trace->blocks[index + j];
+				mm_free_batch(trace->batch, count);
+				break;
+
+			case SIZED_FREE: /* mm_free_sized */
+				index = trace->ops[i].index;
+				mm_free_sized(trace->blocks[index], trace->ops[i].size);
+				break;
+
 			default:
 				app_error("Nonexistent request type in eval_mm_speed");
 		}
@@ -1110,7 +1302,7 @@ static void eval_mm_speed(void *ptr)
  */
 static int eval_libc_valid(trace_t *trace)
 {
-	int i, newsize;
+	int i, j, newsize;
 	char *p, *newp, *oldp;
 
 	reinit_trace(trace);
@@ -1144,6 +1336,25 @@ static int eval_libc_valid(trace_t *trace)
 				}
 				break;
 
+			case BATCH_ALLOC: /* malloc, one block at a time */
+				for (j = 0; j < trace->ops[i].count; j++) {
+					if ((p = malloc(trace->ops[i].size)) == NULL) {
+						malloc_error(trace, i, "libc malloc failed");
+						unix_error("System message");
+					}
+					trace->blocks[trace->ops[i].index + j] = p;
+				}
+				break;
+
+			case BATCH_FREE: /* free, one block at a time */
+				for (j = 0; j < trace->ops[i].count; j++)
+					free(trace->blocks[trace->ops[i].index + j]);
+				break;
+
+			case SIZED_FREE: /* free */
+				free(trace->blocks[trace->ops[i].index]);
+				break;
+
 			default:
 				app_error("invalid operation type  in eval_libc_valid");
 		}
@@ -1159,7 +1370,7 @@ static int eval_libc_valid(trace_t *trace)
  */
 static void eval_libc_speed(void *ptr)
 {
-	int i;
+	int i, j;
 	int index, size, newsize;
 	char *p, *newp, *oldp, *block;
 	trace_t *trace = ((speed_t *)ptr)->trace;
@@ -1195,10 +1406,91 @@ static void eval_libc_speed(void *ptr)
 					free(0);
 				}
 				break;
+
+			case BATCH_ALLOC: /* malloc, one block at a time */
+				index = trace->ops[i].index;
+				size = trace->ops[i].size;
+				for (j = 0; j < trace->ops[i].count; j++) {
+					if ((p = malloc(size)) == NULL)
+						unix_error("malloc failed in eval_libc_speed");
+					trace->blocks[index + j] = p;
+				}
+				break;
+
+			case BATCH_FREE: /* free, one block at a time */
+				index = trace->ops[i].index;
+				for (j = 0; j < trace->ops[i].count; j++)
+					free(trace->blocks[index + j]);
+				break;
+
+			case SIZED_FREE: /* free */
+				free(trace->blocks[trace->ops[i].index]);
+				break;
 		}
 	}
 }
 
+/*
+ * eval_mm_stats - Run the trace once more for the statistics of the
+ *    mm package: what its free lists held when the most payload was
+ *    live, and what it counted over the whole run
+ */
+static void eval_mm_stats(trace_t *trace, stats_t *stats)
+{
+	int i, j, index, count;
+	char *p;
+
+	reinit_trace(trace);
+	mem_reset_brk();
+	if (mm_init() < 0)
+		app_error("mm_init failed in eval_mm_stats");
+
+	for (i = 0;  i < trace->num_ops;  i++) {
+		index = trace->ops[i].index;
+		switch (trace->ops[i].type) {
+
+			case ALLOC: /* mm_malloc */
+				if ((p = mm_malloc(trace->ops[i].size)) == NULL)
+					app_error("mm_malloc error in eval_mm_stats");
+				trace->blocks[index] = p;
+				break;
+
+			case REALLOC: /* mm_realloc */
+				p = mm_realloc(trace->blocks[index], trace->ops[i].size);
+				if (p == NULL && trace->ops[i].size != 0)
+					app_error("mm_realloc error in eval_mm_stats");
+				trace->blocks[index] = p;
+				break;
+
+			case FREE: /* mm_free */
+				mm_free(index < 0 ? NULL : trace->blocks[index]);
+				break;
+
+			case BATCH_ALLOC: /* mm_malloc_batch */
+				count = trace->ops[i].count;
+				if (mm_malloc_batch(trace->ops[i].size, count, trace->batch) != count)
+					app_error("mm_malloc_batch error in eval_mm_stats");
+				for (j = 0; j < count; j++)
+					trace->blocks[index + j] = trace->batch[j];
+				break;
+
+			case BATCH_FREE: /* mm_free_batch */
+				count = trace->ops[i].count;
+				for (j = 0; j < count; j++)
+					trace->batch[j] = trace->blocks[index + j];
+				mm_free_batch(trace->batch, count);
+				break;
+
+			case SIZED_FREE: /* mm_free_sized */
+				mm_free_sized(trace->blocks[index], trace->ops[i].size);
+				break;
+		}
+		if (i == stats->peak_op)
+			mm_stats(&stats->at_peak);
+	}
+	mm_stats(&stats->at_end);
+}
+
 /*************************************
  * Some miscellaneous helper routines
  ************************************/
@@ -1266,6 +1558,116 @@ static void printresults(int n, stats_t *stats)
 
 }
 
+/*
+ * printperf - print the hardware counters of one run of each trace
+ *     and its software-clock time, all per operation
+ */
+static void printperf(int n, stats_t *stats)
+{
+	int i, c;
+
+	printf("\n  %10s", "ns");
+	for (c = 0; c < PERF_NCOUNTERS; c++)
+		printf("%11s", perf_name(c));
+	printf("  (per op)  trace\n");
+	for (i = 0; i < n; i++) {
+		if (!stats[i].valid)
+			continue;
+		printf("  %10.1f", stats[i].perf.secs * 1e9 / stats[i].ops);
+		for (c = 0; c < PERF_NCOUNTERS; c++) {
+			if (stats[i].perf.valid[c])
+				printf("%11.2f", stats[i].perf.count[c] / stats[i].ops);
+			else
+				printf("%11s", "-");
+		}
+		printf("            %s\n", stats[i].filename);
+	}
+}
+
+/*
+ * printhuge - print the throughput of each trace with the heap on 4 KB
+ *     pages and on huge pages
+ */
+static void printhuge(int n, stats_t *stats)
+{
+	int i;
+
+	printf("\n  %9s%10s%9s  trace\n", "Kops 4KB", "Kops 2MB", "speedup");
+	for (i = 0; i < n; i++) {
+		if (!stats[i].valid)
+			continue;
+		if (stats[i].page_secs[0] == 0 || stats[i].page_secs[1] == 0) {
+			printf("  %9s%10s%9s  %s\n", "-", "-", "-", stats[i].filename);
+			continue;
+		}
+		printf("  %9.0f%10.0f%9.2f  %s\n",
+				(stats[i].ops/1e3)/stats[i].page_secs[0],
+				(stats[i].ops/1e3)/stats[i].page_secs[1],
+				stats[i].page_secs[0]/stats[i].page_secs[1],
+				stats[i].filename);
+	}
+}
+
+/*
+ * printstats - print, for each trace, what the mm package did per op
+ *     and how fragmented its free memory was at the peak
+ */
+static void printstats(int n, stats_t *stats)
+{
+	mm_stats_t *e, *p;
+	int i, c, b;
+
+	for (i = 0; i < n; i++) {
+		if (!stats[i].valid)
+			continue;
+		e = &stats[i].at_end;
+		p = &stats[i].at_peak;
+		printf("\n%s:\n", stats[i].filename);
+		if (!e->counted) {
+			printf("  (counters off: make mdriver-stats, which builds mm.c with -DMM_STATS)\n");
+		} else {
+			printf("  per op:%8s%8s%8s%8s%8s%8s%8s%8s%8s%8s\n", "malloc", "free",
+					"realloc", "fit", "place", "insert", "delete",
+					"split", "merge", "quick");
+			printf("  %14.3f%8.3f%8.3f%8.3f%8.3f%8.3f%8.3f%8.3f%8.3f%8.3f\n",
+					e->mallocs / stats[i].ops, e->frees / stats[i].ops,
+					e->reallocs / stats[i].ops, e->fits / stats[i].ops,
+					e->places / stats[i].ops, e->inserts / stats[i].ops,
+					e->deletes / stats[i].ops, e->splits / stats[i].ops,
+					e->coalesces / stats[i].ops, e->quick_hits / stats[i].ops);
+			printf("  blocks looked at per fit:");
+			for (b = 0; b < MM_STAT_PROBES; b++) {
+				if (e->probes[b] == 0)
+					continue;
+				if (b < 2)
+					printf("  %d: %lu", b, e->probes[b]);
+				else if (b < MM_STAT_PROBES - 1)
+					printf("  %d-%d: %lu", 1 << (b - 1), (1 << b) - 1, e->probes[b]);
+				else
+					printf("  %d+: %lu", 1 << (b - 1), e->probes[b]);
+			}
+			printf("\n  heap grew %lu times by %lu bytes; %lu consolidations;"
+					" internal fragmentation %.1f%%\n",
+					e->extends, (unsigned long)e->extend_bytes,
+					e->consolidations, e->internal * 100.0);
+		}
+		printf("  at peak (op %d): heap %lu, mapped %lu, free %lu, largest %lu,"
+				" quick %lu; external fragmentation %.1f%%\n",
+				stats[i].peak_op, (unsigned long)p->heap_bytes,
+				(unsigned long)p->mapped_bytes, (unsigned long)p->free_bytes,
+				(unsigned long)p->largest_free, (unsigned long)p->quick_bytes,
+				p->external * 100.0);
+		printf("  %8s%8s%10s\n", "class", "blocks", "bytes");
+		for (c = 0; c < p->nclasses; c++)
+			if (p->list_blocks[c] != 0)
+				printf("  %8d%8lu%10lu\n", c, p->list_blocks[c],
+						(unsigned long)p->list_bytes[c]);
+		if (p->tree_blocks != 0)
+			printf("  %8s%8lu%10lu\n", "tree", p->tree_blocks,
+					(unsigned long)p->tree_bytes);
+	}
+}
+
 /*
  * app_error - Report an arbitrary application error
  */
@@ -1311,7 +1713,7 @@ void malloc_error(const trace_t *trace, int opnum, const char *fmt, ...)
  */
 static void usage(void)
 {
-	fprintf(stderr, "Usage: mdriver [-hlVdD] [-f <file>]\n");
+	fprintf(stderr, "Usage: mdriver [-hlVdDpHS] [-f <file>]\n");
 	fprintf(stderr, "Options\n");
 	fprintf(stderr, "\t-d <i>     Debug: 0 off; 1 default; 2 lots.\n");
 	fprintf(stderr, "\t-D         Equivalent to -d2.\n");
@@ -1323,4 +1725,7 @@ static void usage(void)
 	fprintf(stderr, "\t-v <i>     Set Verbosity Level to <i>\n");
 	fprintf(stderr, "\t-s <s>     Timeout after s secs (default no timeout)\n");
 	fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
+	fprintf(stderr, "\t-p         Also report hardware counters per trace.\n");
+	fprintf(stderr, "\t-H         Also time each trace on 4 KB and on huge pages.\n");
+	fprintf(stderr, "\t-S         Also dump the allocator's statistics per trace.\n");
 }
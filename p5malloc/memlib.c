@@ -3,6 +3,7 @@
  *            allows us to interleave calls from the student's malloc package 
  *            with the system's malloc package in libc.
  */
+#define _GNU_SOURCE          /* mremap */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -15,16 +16,64 @@
 #include "config.h"
 
 /* private variables */
-static char heap[MAX_HEAP];
-static char *mem_brk = heap; /* points to last byte of heap */
-static char *mem_max_addr = heap + MAX_HEAP;  /* largest legal heap address */ 
+static char *heap;           /* first byte of the heap, page aligned */
+static char *mem_brk;        /* points to last byte of heap */
+static size_t mem_peak;      /* most bytes held, heap and mappings, since the last reset */
+static char *mem_max_addr;   /* largest legal heap address */ 
+static char *mem_commit;     /* heap bytes below this are accessible */
+static char commit_lock;     /* serializes commit() */
+static int mem_huge;         /* is the heap advised to use huge pages? */
+
+/* Mappings handed out by mem_map, beside the heap */
+typedef struct {
+    char *addr;
+    size_t len;
+} mapping_t;
+
+static mapping_t *maps;      /* the live mappings, in no order */
+static int nmaps, maxmaps;
+static size_t mem_mapped;    /* bytes in them */
+static char maps_lock;       /* guards the three above */
+
+#define MAPS_LOCK()	while (__atomic_test_and_set(&maps_lock, __ATOMIC_ACQUIRE))
+#define MAPS_UNLOCK()	__atomic_clear(&maps_lock, __ATOMIC_RELEASE)
+
+static int commit(char *brk);
+static void note_peak(size_t held);
+static mapping_t *find_mapping(char *addr);
+
+#define PAGE_UP(p)	((char *)(((unsigned long)(p) + mem_pagesize() - 1) & ~(mem_pagesize() - 1)))
+#define PAGE_DOWN(p)	((char *)((unsigned long)(p) & ~(mem_pagesize() - 1)))
 
 /* 
- * mem_init - initialize the memory system model
+ * mem_init - initialize the memory system model. The heap is an
+ *    anonymous mapping, so that pages it no longer needs can be
+ *    handed back to the kernel. All MAX_HEAP bytes of it are only
+ *    reserved; mem_sbrk makes them accessible as the break grows.
+ *    The heap starts on a HUGE_SIZE boundary, so that the kernel can
+ *    back it with huge pages from its first byte.
  */
 void mem_init(void)
 {
-  mem_brk = heap;                  /* heap is empty initially */
+    char *map;
+    size_t lead;
+
+    map = mmap(NULL, MAX_HEAP + HUGE_SIZE, PROT_NONE,
+	       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (map == MAP_FAILED) {
+	fprintf(stderr, "ERROR: mem_init failed to map the heap: %s\n",
+		strerror(errno));
+	exit(1);
+    }
+    lead = -(unsigned long)map & (HUGE_SIZE - 1);
+    if (lead > 0)
+	munmap(map, lead);
+    munmap(map + lead + MAX_HEAP, HUGE_SIZE - lead);
+    heap = map + lead;
+    mem_brk = mem_commit = heap; /* heap is empty initially */
+    mem_peak = 0;
+    mem_max_addr = heap + MAX_HEAP;
+    mem_set_hugepages(HUGE_PAGES);
 }
 
 /* 
@@ -32,35 +81,256 @@ void mem_init(void)
  */
 void mem_deinit(void)
 {
-  /*    free(mem_start_brk); */
+    mem_reset_brk();
+    munmap(heap, MAX_HEAP);
+    free(maps);
+    maps = NULL;
+    maxmaps = 0;
 }
 
 /*
- * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ * mem_reset_brk - reset the simulated brk pointer to make an empty heap,
+ *    and unmap whatever mem_map handed out
  */
 void mem_reset_brk()
 {
+    int i;
+
+    for (i = 0; i < nmaps; i++)
+	munmap(maps[i].addr, maps[i].len);
+    nmaps = 0;
+    mem_mapped = 0;
     mem_brk = heap;
+    mem_peak = 0;
 }
 
 /* 
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ *    by incr bytes and returns the start address of the new area.
+ *    A negative incr shrinks the heap and releases the pages past the
+ *    new break. The break is an atomic bump pointer, so threads may
+ *    grow the heap concurrently; shrinking it while another thread
+ *    grows it would release that thread's pages.
  */
-void *mem_sbrk(int incr) 
+void *mem_sbrk(intptr_t incr) 
 {
-    char *old_brk = mem_brk;
+    char *old_brk = __atomic_load_n(&mem_brk, __ATOMIC_RELAXED);
+
+    do {
+	if ( ((old_brk + incr) < heap) || ((old_brk + incr) > mem_max_addr)) {
+	    errno = ENOMEM;
+	    fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
+	    return (void *)-1;
+	}
+    } while (!__atomic_compare_exchange_n(&mem_brk, &old_brk, old_brk + incr,
+					  1, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
 
-    if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
-	errno = ENOMEM;
-	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
-	return (void *)-1;
+    if (incr < 0) {
+	mem_release(old_brk + incr, -incr);
+    } else {
+	if (old_brk + incr > __atomic_load_n(&mem_commit, __ATOMIC_ACQUIRE) &&
+	    commit(old_brk + incr) < 0) {
+	    fprintf(stderr, "ERROR: mem_sbrk failed to commit the heap: %s\n",
+		    strerror(errno));
+	    errno = ENOMEM;
+	    return (void *)-1;
+	}
+	note_peak(old_brk + incr - heap + mem_mapped);
     }
-    mem_brk += incr;
     return (void *)old_brk;
 }
 
+/*
+ * commit - make the heap accessible up to brk, COMMIT_STEP bytes at a
+ *    time. Returns -1 if the kernel refuses.
+ */
+static int commit(char *brk)
+{
+    char *hi;
+    int ret = 0;
+
+    while (__atomic_test_and_set(&commit_lock, __ATOMIC_ACQUIRE))
+	;
+    if (brk > mem_commit) {
+	hi = heap + ((brk - heap + COMMIT_STEP - 1) & ~(size_t)(COMMIT_STEP - 1));
+	if (hi > mem_max_addr)
+	    hi = mem_max_addr;
+	if (mprotect(mem_commit, hi - mem_commit, PROT_READ | PROT_WRITE) < 0)
+	    ret = -1;
+	else
+	    __atomic_store_n(&mem_commit, hi, __ATOMIC_RELEASE);
+    }
+    __atomic_clear(&commit_lock, __ATOMIC_RELEASE);
+    return ret;
+}
+
+/*
+ * mem_map - a fresh zeroed mapping of len bytes, rounded up to whole
+ *    pages, beside the heap. Returns NULL if there is no memory left.
+ */
+void *mem_map(size_t len)
+{
+    char *addr;
+    mapping_t *grown;
+
+    len = (len + mem_pagesize() - 1) & ~(mem_pagesize() - 1);
+    addr = mmap(NULL, len, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED)
+	return NULL;
+
+    MAPS_LOCK();
+    if (nmaps == maxmaps) {
+	grown = realloc(maps, sizeof(mapping_t) * (maxmaps ? 2 * maxmaps : 16));
+	if (grown == NULL) {
+	    MAPS_UNLOCK();
+	    munmap(addr, len);
+	    return NULL;
+	}
+	maps = grown;
+	maxmaps = maxmaps ? 2 * maxmaps : 16;
+    }
+    maps[nmaps].addr = addr;
+    maps[nmaps++].len = len;
+    mem_mapped += len;
+    note_peak(mem_heapsize() + mem_mapped);
+    MAPS_UNLOCK();
+    return addr;
+}
+
+/*
+ * mem_unmap - give back a mapping mem_map or mem_remap returned
+ */
+void mem_unmap(void *addr)
+{
+    mapping_t *m;
+
+    MAPS_LOCK();
+    if ((m = find_mapping(addr)) == NULL) {
+	MAPS_UNLOCK();
+	fprintf(stderr, "ERROR: mem_unmap of %p, which is not mapped\n", addr);
+	return;
+    }
+    munmap(m->addr, m->len);
+    mem_mapped -= m->len;
+    *m = maps[--nmaps];
+    MAPS_UNLOCK();
+}
+
+/*
+ * mem_remap - resize a mapping to len bytes, rounded up to whole pages,
+ *    moving it if it cannot grow where it is. The kernel moves the
+ *    pages, not their contents. Returns the new address, or NULL with
+ *    the old mapping untouched.
+ */
+void *mem_remap(void *addr, size_t len)
+{
+    mapping_t *m;
+    char *moved;
+
+    len = (len + mem_pagesize() - 1) & ~(mem_pagesize() - 1);
+    MAPS_LOCK();
+    if ((m = find_mapping(addr)) == NULL) {
+	MAPS_UNLOCK();
+	fprintf(stderr, "ERROR: mem_remap of %p, which is not mapped\n", addr);
+	return NULL;
+    }
+    moved = mremap(m->addr, m->len, len, MREMAP_MAYMOVE);
+    if (moved == MAP_FAILED) {
+	MAPS_UNLOCK();
+	return NULL;
+    }
+    mem_mapped += len - m->len;
+    m->addr = moved;
+    m->len = len;
+    note_peak(mem_heapsize() + mem_mapped);
+    MAPS_UNLOCK();
+    return moved;
+}
+
+/*
+ * mem_is_mapped - is [lo, hi] inside one of the live mappings?
+ */
+int mem_is_mapped(void *lo, void *hi)
+{
+    int i, found = 0;
+
+    MAPS_LOCK();
+    for (i = 0; i < nmaps && !found; i++)
+	found = (char *)lo >= maps[i].addr &&
+	    (char *)hi < maps[i].addr + maps[i].len;
+    MAPS_UNLOCK();
+    return found;
+}
+
+/*
+ * find_mapping - the entry of the mapping starting at addr, or NULL;
+ *    the caller holds maps_lock
+ */
+static mapping_t *find_mapping(char *addr)
+{
+    int i;
+
+    for (i = 0; i < nmaps; i++)
+	if (maps[i].addr == addr)
+	    return &maps[i];
+    return NULL;
+}
+
+/*
+ * note_peak - raise mem_peak to held bytes if that is more
+ */
+static void note_peak(size_t held)
+{
+    size_t peak = __atomic_load_n(&mem_peak, __ATOMIC_RELAXED);
+
+    while (held > peak &&
+	   !__atomic_compare_exchange_n(&mem_peak, &peak, held,
+					1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+	;
+}
+
+/*
+ * mem_set_hugepages - advise the kernel to back the heap with huge
+ *    pages (on = 1) or not (on = 0). The pages the heap holds are
+ *    released first, so that it faults in afresh with the new size:
+ *    only call this between traces. Returns -1 if the kernel has no
+ *    transparent huge pages.
+ */
+int mem_set_hugepages(int on)
+{
+    mem_release(heap, mem_commit - heap);
+    if (madvise(heap, MAX_HEAP, on ? MADV_HUGEPAGE : MADV_NOHUGEPAGE) < 0)
+	return -1;
+    mem_huge = on;
+    return 0;
+}
+
+/*
+ * mem_hugepages - is the heap advised to use huge pages?
+ */
+int mem_hugepages(void)
+{
+    return mem_huge;
+}
+
+/*
+ * mem_release - give the pages lying wholly inside [addr, addr+len)
+ *    back to the kernel, as madvise(MADV_DONTNEED) does; they read as
+ *    zeros when next touched. Returns the number of bytes released.
+ */
+size_t mem_release(void *addr, size_t len)
+{
+    char *lo = PAGE_UP(addr);
+    char *hi = PAGE_DOWN((char *)addr + len);
+
+    if (hi <= lo)
+	return 0;
+    if (madvise(lo, hi - lo, MADV_DONTNEED) < 0)
+	return 0;
+    return hi - lo;
+}
+
 /*
  * mem_heap_lo - return address of the first heap byte
  */
@@ -70,11 +340,12 @@ void *mem_heap_lo()
 }
 
 /* 
- * mem_heap_hi - return address of last heap byte
+ * mem_heap_hi - return address of last heap byte. Other threads may
+ *    be moving the break in mem_sbrk, so it is read atomically.
  */
 void *mem_heap_hi()
 {
-    return (void *)(mem_brk - 1);
+    return (void *)(__atomic_load_n(&mem_brk, __ATOMIC_ACQUIRE) - 1);
 }
 
 /*
@@ -82,7 +353,24 @@ void *mem_heap_hi()
  */
 size_t mem_heapsize() 
 {
-    return (size_t)((void *)mem_brk - (void *)heap);
+    return (size_t)((void *)__atomic_load_n(&mem_brk, __ATOMIC_ACQUIRE) - (void *)heap);
+}
+
+/*
+ * mem_mapsize() - returns the bytes held in mappings from mem_map
+ */
+size_t mem_mapsize() 
+{
+    return mem_mapped;
+}
+
+/*
+ * mem_peak_heapsize() - returns the most bytes held at once, by the
+ *    heap and the mappings together, since the last mem_reset_brk()
+ */
+size_t mem_peak_heapsize() 
+{
+    return mem_peak;
 }
 
 /*
@@ -2,10 +2,19 @@
 
 void mem_init(void);               
 void mem_deinit(void);
-void *mem_sbrk(int incr);
+void *mem_sbrk(intptr_t incr);
 void mem_reset_brk(void); 
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
+size_t mem_peak_heapsize(void);
+size_t mem_release(void *addr, size_t len);
+int mem_set_hugepages(int on);
+int mem_hugepages(void);
+void *mem_map(size_t len);
+void mem_unmap(void *addr);
+void *mem_remap(void *addr, size_t len);
+int mem_is_mapped(void *lo, void *hi);
+size_t mem_mapsize(void);
 size_t mem_pagesize(void);
 
@@ -0,0 +1,304 @@
+/*
+ * mkclasses.c - Size classes of mm.c's free lists, fitted to traces
+ *
+ * Reads .rep traces, by default the DEFAULT_TRACEFILES of config.h,
+ * and histograms the block sizes mm.c would carve for them on the free
+ * lists (between SLAB_MAX and TREE_MIN), with how many blocks of each
+ * size are requested, how many are freed and how long they live.
+ *
+ * A list holding sizes [lo, hi) makes a request of size s walk past
+ * the blocks of the list that are smaller than s. Taking the blocks on
+ * a list to be those freed into it, the probes this costs grow as
+ *
+ *     sum over s of  requests(s) * freed(sizes < s)
+ *
+ * which is 0 for a class of a single size. The class boundaries are
+ * put at requested sizes by dynamic programming to minimize the total
+ * over all classes. Splitting hands out exactly the size asked for, so
+ * the classes cost no internal fragmentation; what a poor fit costs is
+ * the walk. Above the largest size seen, classes double up to TREE_MIN,
+ * for the sizes that coalescing makes.
+ *
+ * The result is a header for mm.c: NUMLIST and class_of, a table that
+ * maps a block size in units of 8 bytes to its class.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <float.h>
+
+#include "config.h"
+
+/* As in mm.c */
+#define OVERHEAD    4
+#define SLAB_MAX    16
+#define TREE_MIN    (1 << 15)
+#define MMAP_THRESHOLD	(1 << 20)
+#define MIN_SIZE    16              /* smallest free block */
+#define MAX_CLASSES 64              /* bits of free_map */
+
+#define MAXLINE     1024
+#define GRAINS      (TREE_MIN / 8)  /* sizes a list may hold, in units of 8 */
+
+static double requests[GRAINS];     /* blocks asked for, per size */
+static double freed[GRAINS];        /* blocks freed, per size */
+static double lifetime[GRAINS];     /* sum over freed blocks of the ops they lived */
+
+/*
+ * block_size - Size of the list block mm.c carves for a request of size
+ *     bytes, or 0 if the request is not served from the lists
+ */
+static int block_size(unsigned int size)
+{
+    size_t asize = 8 * ((size + OVERHEAD + 7) / 8);
+
+    if (size <= SLAB_MAX || size >= MMAP_THRESHOLD || asize >= TREE_MIN)
+        return 0;
+    return asize;
+}
+
+/*
+ * read_trace - Add the requests of one trace to the histograms
+ */
+static void read_trace(const char *path)
+{
+    FILE *fp;
+    char type[2];
+    int weight, num_ids, num_ops, ignore, op = 0;
+    unsigned int index, count, size, i;
+    int *bsize, *born;
+
+    if ((fp = fopen(path, "r")) == NULL) {
+        perror(path);
+        exit(1);
+    }
+    if (fscanf(fp, "%d %d %d %d", &weight, &num_ids, &num_ops, &ignore) != 4) {
+        fprintf(stderr, "%s: bad trace header\n", path);
+        exit(1);
+    }
+    bsize = calloc(num_ids, sizeof(int));
+    born = calloc(num_ids, sizeof(int));
+    if (bsize == NULL || born == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+
+    /* A batch op ("A index count size", "F index count") stands for
+       count ops on consecutive blocks; "s index" is a free */
+    while (fscanf(fp, "%1s", type) == 1) {
+        op++;
+        count = 1;
+        if (type[0] == 'f' || type[0] == 's') {
+            if (fscanf(fp, "%u", &index) != 1)
+                break;
+            type[0] = 'f';
+        } else if (type[0] == 'F') {
+            if (fscanf(fp, "%u %u", &index, &count) != 2)
+                break;
+            type[0] = 'f';
+        } else if (type[0] == 'A') {
+            if (fscanf(fp, "%u %u %u", &index, &count, &size) != 3)
+                break;
+            type[0] = 'a';
+        } else if (fscanf(fp, "%u %u", &index, &size) != 2) {
+            break;
+        }
+        if (index >= num_ids || count > num_ids - index)
+            break;
+        for (i = index; i < index + count; i++) {
+            /* A free or a realloc ends the life of the old block */
+            if (type[0] != 'a' && bsize[i] != 0) {
+                freed[bsize[i] / 8]++;
+                lifetime[bsize[i] / 8] += op - born[i];
+            }
+            bsize[i] = 0;
+            if (type[0] != 'f' && (bsize[i] = block_size(size)) != 0) {
+                requests[bsize[i] / 8]++;
+                born[i] = op;
+            }
+        }
+    }
+    fclose(fp);
+    free(bsize);
+    free(born);
+}
+
+/*
+ * fit_classes - Split the sizes in point[0..m) into at most k classes
+ *     with the fewest expected probes; the classes start at the
+ *     points first[0..n), and n is returned
+ */
+static int fit_classes(const int *point, int m, int k, int *first)
+{
+    double *cost = malloc(sizeof(double) * (k + 1) * (m + 1));
+    int *cut = malloc(sizeof(int) * (k + 1) * (m + 1));
+    double num, req, c;
+    int i, j, l, n;
+
+#define COST(l, j)  cost[(l) * (m + 1) + (j)]
+#define CUT(l, j)   cut[(l) * (m + 1) + (j)]
+    if (cost == NULL || cut == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    if (k > m)
+        k = m;
+    for (l = 0; l <= k; l++)
+        for (j = 0; j <= m; j++)
+            COST(l, j) = DBL_MAX;
+    COST(0, 0) = 0;
+
+    /* COST(l, j): the first j points in l classes */
+    for (l = 1; l <= k; l++) {
+        for (j = l; j <= m; j++) {
+            /* Grow the last class [i, j) to the left; its blocks of
+               size point[i] are too small for every request above */
+            num = req = 0;
+            for (i = j - 1; i >= l - 1; i--) {
+                num += freed[point[i]] * req;
+                req += requests[point[i]];
+                if (COST(l - 1, i) == DBL_MAX)
+                    continue;
+                c = COST(l - 1, i) + num;
+                if (c < COST(l, j)) {
+                    COST(l, j) = c;
+                    CUT(l, j) = i;
+                }
+            }
+        }
+    }
+
+    /* Splitting a class may not pay, so take the best count */
+    for (l = n = 1; l <= k; l++)
+        if (COST(l, m) < COST(n, m))
+            n = l;
+    printf("blocks too small, summed over requests: %.0f\n", COST(n, m));
+    for (l = n, j = m; l > 0; l--) {
+        first[l - 1] = CUT(l, j);
+        j = CUT(l, j);
+    }
+    free(cost);
+    free(cut);
+    return n;
+#undef COST
+#undef CUT
+}
+
+/*
+ * usage - Print usage info
+ */
+static void usage(char *argv[])
+{
+    printf("Usage: %s [-h] [-n <classes>] [-d <dir>] [-o <file>] [trace...]\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h          Print this help message.\n");
+    printf("  -n <n>      Number of classes, at most %d (default 48)\n", MAX_CLASSES);
+    printf("  -d <dir>    Directory of the traces (default %s)\n", TRACEDIR);
+    printf("  -o <file>   Header to write (default sizeclasses.h)\n");
+    printf("Without traces, the DEFAULT_TRACEFILES of config.h are read.\n");
+}
+
+int main(int argc, char *argv[])
+{
+    char *default_tracefiles[] = { DEFAULT_TRACEFILES, NULL };
+    char **traces = default_tracefiles;
+    char *dir = TRACEDIR, *out = "sizeclasses.h";
+    char path[MAXLINE];
+    int point[GRAINS], first[MAX_CLASSES], class_of[GRAINS];
+    int c, i, g, m, n, nfixed, top, nclasses = 48;
+    double req, fre, life;
+    FILE *fp;
+
+    while ((c = getopt(argc, argv, "n:d:o:h")) != -1) {
+        switch (c) {
+        case 'n':
+            nclasses = atoi(optarg);
+            break;
+        case 'd':
+            dir = optarg;
+            break;
+        case 'o':
+            out = optarg;
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+    if (nclasses < 2 || nclasses > MAX_CLASSES) {
+        usage(argv);
+        exit(1);
+    }
+    if (optind < argc) {
+        traces = argv + optind;
+        dir = "";
+    }
+    for (i = 0; traces[i] != NULL; i++) {
+        snprintf(path, sizeof(path), "%s%s", dir, traces[i]);
+        read_trace(path);
+    }
+
+    /* The sizes seen; the first class also takes everything below */
+    for (g = MIN_SIZE / 8, m = 0; g < GRAINS; g++)
+        if (requests[g] > 0 || freed[g] > 0)
+            point[m++] = g;
+    if (m == 0) {
+        fprintf(stderr, "No request is served from the lists\n");
+        exit(1);
+    }
+
+    /* Doubling classes above the largest size seen */
+    for (top = 2 * MIN_SIZE / 8, nfixed = 0; top < GRAINS; top *= 2)
+        if (top > point[m - 1])
+            nfixed++;
+    if (nfixed > nclasses / 4)
+        nfixed = nclasses / 4;
+
+    n = fit_classes(point, m, nclasses - nfixed, first);
+    for (i = 0; i < n; i++)
+        first[i] = point[first[i]];
+    first[0] = 0;
+    for (top = GRAINS >> nfixed; n < nclasses && top < GRAINS; top *= 2)
+        if (top > first[n - 1])
+            first[n++] = top;
+    for (i = 0, g = 0; g < GRAINS; g++) {
+        if (i + 1 < n && g == first[i + 1])
+            i++;
+        class_of[g] = i;
+    }
+
+    if ((fp = fopen(out, "w")) == NULL) {
+        perror(out);
+        exit(1);
+    }
+    for (i = 0; traces[i] != NULL; i++)
+        ;
+    fprintf(fp, "/*\n * %s - Size classes of mm.c's free lists, made by mkclasses\n", out);
+    fprintf(fp, " *     from %d traces; run \"make classes\" rather than edit it.\n", i);
+    fprintf(fp, " *\n *  class  from bytes   requests   freed  mean lifetime (ops)\n");
+    for (i = 0; i < n; i++) {
+        req = fre = life = 0;
+        for (g = first[i]; g < (i + 1 < n ? first[i + 1] : GRAINS); g++) {
+            req += requests[g];
+            fre += freed[g];
+            life += lifetime[g];
+        }
+        fprintf(fp, " * %6d %11d %10.0f %7.0f %14.0f\n", i,
+                i == 0 ? MIN_SIZE : first[i] * 8, req, fre, fre > 0 ? life / fre : 0);
+    }
+    fprintf(fp, " */\n");
+    fprintf(fp, "#define NUMLIST     %d\n", n);
+    fprintf(fp, "#define CLASS_LIMIT %d\t/* class_of covers sizes below this */\n\n", TREE_MIN);
+    fprintf(fp, "/* Class of a block of 8 * i bytes */\n");
+    fprintf(fp, "static const unsigned char class_of[CLASS_LIMIT / 8] = {");
+    for (g = 0; g < GRAINS; g++)
+        fprintf(fp, "%s%d,", g % 16 ? " " : "\n    ", class_of[g]);
+    fprintf(fp, "\n};\n");
+    fclose(fp);
+    printf("%d classes written to %s\n", n, out);
+    return 0;
+}
@@ -2,10 +2,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "mm.h"
 #include "memlib.h"
+#include "sizeclasses.h"    /* NUMLIST and class_of, made by mkclasses */
 
 //#define DEBUG
 #ifdef DEBUG
@@ -23,21 +25,120 @@
 
 #define WSIZE       4
 #define DSIZE       8
-#define OVERHEAD    8
+#define OVERHEAD    4	/* allocated blocks only have a header */
 #define ALIGNMENT   8
-#define NUMLIST 	15
+#define TREE_MIN	(1<<15)	/* free blocks this large go into the tree */
+#if CLASS_LIMIT != TREE_MIN || NUMLIST > 64 || NUMLIST > MM_STAT_CLASSES
+#error "sizeclasses.h does not fit TREE_MIN and free_map; run make classes"
+#endif
 #define CHUNKSIZE   (1<<8)
+#define RESERVE(size)	((size) >> 2)	/* slack given to a block realloc grows */
+
+/* Freed blocks of up to QUICK_MAX bytes go on quick lists, one per
+   size, still marked allocated: the next request of that size pops
+   one without splitting or list surgery. They are coalesced for real
+   once QUICK_BYTES of them pile up, or when a request above QUICK_MAX
+   finds no fit. A small request that misses takes a free block or
+   grows the heap instead: coalescing for it would undo the lists
+   every time the sizes shift. */
+#define QUICK_MAX   	256
+#define QUICK_BINS  	(QUICK_MAX / DSIZE + 1)	/* bin i holds blocks of i * DSIZE bytes */
+#define QUICK_BYTES 	(1<<14)
+
+/* Requests of MMAP_THRESHOLD bytes or more get a mapping of their own
+   from mem_map, so they never fragment the heap and realloc moves their
+   pages instead of copying them. A mapping starts with its length, then
+   a header tagged MAPPED, then the payload MAP_HDR bytes in. Every heap
+   block lies between heap_base and the break, which is what tells a
+   mapped block apart without reading in front of a slab slot. */
+#define MMAP_THRESHOLD	(1<<20)
+#define MAP_HDR     	(2 * DSIZE)
+#define MAPPED      	PACK(0, 1)	/* size 0, as only the epilogue has */
+
+/* Returning memory: each time PURGE_BYTES have been freed into an
+   arena's tree, the pages inside its tree blocks that have stayed free
+   for DECAY_MS are released, and a free block of TRIM_THRESHOLD bytes
+   or more that has stayed at the top of the heap as long is cut back
+   to TOP_PAD bytes. Memory that is reused soon is not handed back and
+   faulted in again. Blocks are stamped with the time of the previous
+   pass, which saves reading the clock on every free. */
+#define TRIM_THRESHOLD	(1<<17)
+#define TOP_PAD     	(1<<16)
+#define PURGE_BYTES 	(1<<20)
+#define DECAY_MS    	1000
+
+/* Requests of up to SLAB_MAX bytes are slots of a run: an allocated
+   block of RUN_SIZE bytes starting on a multiple of RUN_SIZE from the
+   heap base, with a run_t at its start and no per-slot header. A bit
+   per RUN_SIZE grain of the heap, in slab_map, tells slots apart from
+   ordinary blocks, and masking a slot's address finds its run. */
+#define SLAB_MAX    16	/* above this the run header outweighs the tags saved */
+#define SLAB_CLASSES	(SLAB_MAX / 8)	/* one per multiple of 8 bytes */
+#define RUN_SHIFT   8	/* small runs: the driver's heaps are tiny */
+#define RUN_SIZE    (1 << RUN_SHIFT)
+#define RUN_HDR     ALIGN(sizeof(run_t))
+#define MIN_BLOCK   ALIGN(SLAB_MAX + 1 + OVERHEAD)	/* smallest block handed out */
+
+/*
+ * Built with -DMM_THREADS the allocator may be called from several
+ * threads at once. Threads are spread round-robin over NARENAS arenas,
+ * each with its own lock, free lists and chunks of the heap. Blocks of
+ * up to TCACHE_MAX bytes are first cached per thread, in bins of one
+ * block size that take and give back blocks a batch per lock. Which
+ * arena a block goes back to is looked up by address in chunk_arena.
+ * mm_init must not run concurrently with anything else.
+ */
+#ifdef MM_THREADS
+#include <pthread.h>
+#define NARENAS     	8	/* arenas threads are spread over */
+#define CHUNK_SHIFT 	16	/* arenas grow by 64KB grains of the heap */
+#define CHUNK_GRAIN 	(1UL << CHUNK_SHIFT)
+#define TCACHE_MAX  	256	/* largest block a thread caches */
+#define TCACHE_BINS 	(TCACHE_MAX / DSIZE + 1)
+#define TCACHE_COUNT	32	/* blocks a bin holds before half goes back */
+#define TCACHE_FILL 	8	/* blocks a refill takes from the arena */
+#define LOCK(a)     	pthread_mutex_lock(&(a)->lock)
+#define UNLOCK(a)   	pthread_mutex_unlock(&(a)->lock)
+#define OWNER(bp)   	(&arenas[chunk_arena[POS(bp) >> CHUNK_SHIFT]])
+#else
+#define NARENAS     	1
+#define LOCK(a)
+#define UNLOCK(a)
+#define OWNER(bp)   	(arenas)
+#endif
+
+/*
+ * Built with -DMM_STATS the allocator counts calls, searches, splits,
+ * merges and heap growth for mm_stats; otherwise STAT compiles to
+ * nothing. The counters are shared by all arenas, so with MM_THREADS
+ * they are bumped atomically.
+ */
+#ifdef MM_STATS
+#ifdef MM_THREADS
+#define STAT(field, n)  	((void)__atomic_fetch_add(&stats.field, (n), __ATOMIC_RELAXED))
+#else
+#define STAT(field, n)  	((void)(stats.field += (n)))
+#endif
+#define STAT_PROBES(n)  	STAT(probes[probe_bucket(n)], 1)
+#else
+#define STAT(field, n)  	((void)0)
+#define STAT_PROBES(n)  	((void)(n))
+#endif
 
 #define MAX(x, y) ((x) > (y)? (x) : (y))
+#define MIN(x, y) ((x) < (y)? (x) : (y))
 
 #define ALIGN(size) (((size_t)(size) + (ALIGNMENT - 1)) & ~0x7)
 
 #define PACK(size, alloc)  ((size) | (alloc))
+#define PREV_ALLOCATED	0x2	/* header bit: the block in front is allocated */
+#define GROWN       	0x4	/* header bit: realloc has grown this block */
 
 #define GET(p)       		(*(unsigned int *)(p))
 #define PUT(p, val)  		(*(unsigned int *)(p) = (val))
 #define GET_SIZE(p)			(GET(p) & ~0x7)
 #define GET_ALLOC(p)		(GET(p) & 0x1)
+#define GET_PREV_ALLOC(p)	(GET(p) & PREV_ALLOCATED)
 
 #define HDPT(bp)			((char *)(bp) - WSIZE)
 #define FTPT(bp)       		((char *)(bp) + GET_SIZE(HDPT(bp)) - DSIZE)
@@ -48,273 +149,1391 @@
 #define PREV_SIZE(bp) 		(GET_SIZE((char *)(bp) - DSIZE)) //size of previous block
 #define NEXT_SIZE(bp) 		(GET_SIZE((char *)(bp) + SIZE(bp) - WSIZE))
 #define ALLOC(bp)     		(GET_ALLOC(HDPT(bp)))
-#define PREV(bp)      		((char *)(bp) - GET(bp))
-#define NEXT(bp)      		((char *)(bp) + GET((char *)(bp) + WSIZE))
-#define PUT_PREV(bp, pre)	PUT(bp, (unsigned int)((char *)(bp) - (char *)(pre)))
-#define PUT_NEXT(bp, suc)	PUT((char *)(bp) + WSIZE, (unsigned int)((char *)(suc) - (char *)(bp)))
+#define PREV_ALLOC(bp)		(GET_PREV_ALLOC(HDPT(bp)))
+/* Only free blocks have a footer, so PREV_BLKP is only valid when
+   PREV_ALLOC is clear. Headers keep their PREV_ALLOCATED bit across
+   PUT_HDR; the block behind sets and clears it. */
+#define PUT_HDR(bp, size, alloc)	PUT(HDPT(bp), PACK(size, alloc) | PREV_ALLOC(bp))
+#define IS_GROWN(bp)		(GET(HDPT(bp)) & GROWN)
+#define SET_GROWN(bp)		PUT(HDPT(bp), GET(HDPT(bp)) | GROWN)
+#define SET_PREV_ALLOC(bp)	PUT(HDPT(bp), GET(HDPT(bp)) | PREV_ALLOCATED)
+#define CLEAR_PREV_ALLOC(bp)	PUT(HDPT(bp), GET(HDPT(bp)) & ~PREV_ALLOCATED)
+/* Links are offsets from the start of the heap in units of ALIGNMENT,
+   so that 32 bits reach HEAP_REACH bytes; 0 is none. POS is the offset
+   in bytes. */
+#define HEAP_BITS   		35
+#define HEAP_REACH  		(1UL << HEAP_BITS)
+#define OFF(bp)      		((bp) ? (unsigned int)(POS(bp) >> 3) : 0)
+#define PTR(off)     		((off) ? heap_base + ((size_t)(off) << 3) : NULL)
+#define POS(bp)      		((size_t)((char *)(bp) - heap_base))
+/* Headers hold sizes in 32 bits, so free blocks stop coalescing here */
+#define MAX_FREE    		(0x100000000UL - ALIGNMENT)
+
+#define IS_MAPPED(bp) 		((char *)(bp) < heap_base || (char *)(bp) > (char *)mem_heap_hi())
+#define MAP_LEN(bp)   		(*(size_t *)((char *)(bp) - MAP_HDR))	/* of the whole mapping */
+#define PAGE_ROUND(n) 		(((n) + mem_pagesize() - 1) & ~(mem_pagesize() - 1))
+
+/* Small free blocks: LIFO lists linked through the first two payload words */
+#define PREV(bp)      		PTR(GET(bp))
+#define NEXT(bp)      		PTR(GET((char *)(bp) + WSIZE))
+#define PUT_PREV(bp, pre)	PUT(bp, OFF(pre))
+#define PUT_NEXT(bp, suc)	PUT((char *)(bp) + WSIZE, OFF(suc))
+#define HEAD(a, i)     		PTR((a)->free_head[i])
+#define PUT_HEAD(a, i, bp)	((a)->free_head[i] = OFF(bp))
+
+/* Large free blocks: treap nodes keyed by (size, address), with the
+   children in the first two payload words and a priority hashed from
+   the address, so a node needs no more room than a list entry */
+#define LEFT(bp)      		(*(unsigned int *)(bp))
+#define RIGHT(bp)     		(*((unsigned int *)(bp) + 1))
+#define PRIO(bp)      		(OFF(bp) * 2654435761u)
+#define LESS(a, b)    		(SIZE(a) < SIZE(b) || (SIZE(a) == SIZE(b) && (char *)(a) < (char *)(b)))
+#define FREED_AT(bp)  		(*((unsigned int *)(bp) + 2))	/* in ms, or RELEASED */
+#define RELEASED    		(~0U)
+
+/* Free lists and tree of one arena, kept at the start of the heap */
+typedef struct arena {
+#ifdef MM_THREADS
+    pthread_mutex_t lock;
+#endif
+    unsigned long free_map;     /* bit i set iff list i is non-empty */
+    unsigned int end;           /* offset just past the arena's last chunk */
+    unsigned int tree_root;     /* offset of the root of the treap */
+    unsigned int freed;         /* bytes freed into the tree since the last purge */
+    unsigned int epoch;         /* time of the last purge, in ms */
+    unsigned int quick_bytes;   /* bytes on the quick lists */
+    unsigned int free_head[NUMLIST]; /* offset of every list head */
+    unsigned int quick_head[QUICK_BINS]; /* offset of every quick list head */
+    unsigned int slab_head[SLAB_CLASSES]; /* offset of a run with free slots */
+} arena_t;
+
+/* Head of a run; runs with free slots are linked per slot size */
+typedef struct run {
+    unsigned int free;          /* bit i set iff slot i is free */
+    unsigned int prev, next;    /* offsets of runs of the same size */
+    unsigned int size;          /* slot size */
+} run_t;
+
+#define SLAB_BIT(bp)  		(POS(bp) >> RUN_SHIFT)
+#define IN_SLAB(bp)   		((slab_map[SLAB_BIT(bp) >> 3] >> (SLAB_BIT(bp) & 7)) & 1)
+#define RUN(bp)       		((run_t *)(heap_base + (POS(bp) & ~(RUN_SIZE - 1))))
+#define RUN_PTR(off)  		((run_t *)PTR(off))
+#define BLOCK_SIZE(bp)		(IN_SLAB(bp) ? RUN(bp)->size : SIZE(bp))
 
 // global variables
-static char *heap_listp = NULL;  
-static size_t *free_head;  /* point to every list head */
-static size_t *free_tail;  /* point to every list tail */
+static char *heap_listp = NULL;
+static char *heap_base;    /* first byte of the heap */
+static arena_t *arenas;    /* NARENAS of them */
+static unsigned char slab_map[1UL << (HEAP_BITS - RUN_SHIFT - 3)]; /* a bit per grain */
+static unsigned int slab_bits;  /* grains slab_map may have bits set for */
+#ifdef MM_STATS
+static mm_stats_t stats;        /* counted since mm_init */
+#endif
+
+#ifdef MM_THREADS
+/* Per-thread cache of allocated blocks, linked through their first
+   payload word; only valid while gen matches heap_gen */
+typedef struct tcache {
+    unsigned long gen;
+    int arena;                  /* this thread's arena */
+    int count[TCACHE_BINS];
+    char *bin[TCACHE_BINS];     /* bin i holds blocks of i * DSIZE bytes */
+} tcache_t;
+
+static unsigned long heap_gen;      /* bumped by every mm_init */
+static unsigned int next_arena;     /* round-robin arena assignment */
+static unsigned char chunk_arena[1UL << (HEAP_BITS - CHUNK_SHIFT)]; /* owner of each grain */
+static __thread tcache_t tcache;
+static pthread_key_t tcache_key;    /* drains the cache on thread exit */
+static pthread_once_t tcache_once = PTHREAD_ONCE_INIT;
+#endif
 
 // helper functions
-static void *extend_heap(size_t asize);
-static void *place(void *bp, size_t asize);
-static void *find_fit(size_t asize);
-static void *coalesce(void *bp);
+static void *arena_malloc(arena_t *a, size_t asize);
+static void arena_free(arena_t *a, void *bp);
+static void quick_free(arena_t *a, char *bp);
+static void quick_push(arena_t *a, char *bp, size_t size);
+static size_t carve(arena_t *a, char *bp, size_t asize, size_t k, void **out);
+static int addr_cmp(const void *x, const void *y);
+static void consolidate(arena_t *a);
+static void *extend_heap(arena_t *a, size_t asize);
+static void *place(arena_t *a, void *bp, size_t asize);
+static void *find_fit(arena_t *a, size_t asize);
+static void *coalesce(arena_t *a, void *bp);
 static int  get_index(size_t size);
-static void *insert(void *bp);
-static void delete(void *bp);
+static void *insert(arena_t *a, void *bp);
+static void delete(arena_t *a, void *bp);
+static void tree_insert(unsigned int *link, char *bp);
+static void tree_delete(unsigned int *link, char *bp);
+static void *tree_fit(arena_t *a, size_t asize, int *probes);
+static void *place_aligned(arena_t *a, size_t asize, size_t align);
+static void split_tail(arena_t *a, char *bp, size_t asize);
+static void *arena_resize(arena_t *a, char *bp, size_t asize);
+static unsigned int now_ms(void);
+static size_t trim_top(arena_t *a, size_t pad, unsigned int now, unsigned int delay);
+static size_t purge(unsigned int off, unsigned int now, unsigned int delay);
+static void *slab_alloc(arena_t *a, size_t ssize);
+static void slab_free(arena_t *a, char *bp);
+static void *map_alloc(size_t size);
+static void *map_resize(char *bp, size_t size);
+static void tree_stats(unsigned int off, mm_stats_t *st);
+#ifdef MM_STATS
+static int probe_bucket(int probes);
+#endif
+#ifdef MM_THREADS
+static tcache_t *thread_cache(void);
+static void *tcache_get(tcache_t *tc, size_t asize);
+static void tcache_put(tcache_t *tc, char *bp, size_t size);
+static void tcache_drain(tcache_t *tc, int i, int n);
+#endif
 
 int mm_init(void)
 {
-    if ((heap_listp = mem_sbrk((4 * (NUMLIST + 1)) * WSIZE)) == NULL) return -1;
-    free_head = (size_t *)heap_listp;
-    free_tail = (size_t *)(heap_listp + (2 * NUMLIST * WSIZE));
-    int i;
+    /* The arenas, padded to a multiple of DSIZE */
+    size_t head = ALIGN(NARENAS * sizeof(arena_t));
+    arena_t *a;
 
-    for (i = 0; i < NUMLIST; i++){
-        free_head[i] = (size_t)NULL;
-        free_tail[i] = (size_t)NULL;
+#ifdef MM_THREADS
+    /* Arenas grow by whole grains, so that every chunk starts on one */
+    head = ((head + 4 * WSIZE + CHUNK_GRAIN - 1) & ~(CHUNK_GRAIN - 1)) - 4 * WSIZE;
+#endif
+    if ((heap_listp = mem_sbrk(head + 4 * WSIZE)) == (void *)-1) return -1;
+    heap_base = heap_listp;
+    arenas = (arena_t *)heap_base;
+    for (a = arenas; a < arenas + NARENAS; a++) {
+        memset(a, 0, sizeof(arena_t));
+        a->epoch = now_ms();
+#ifdef MM_THREADS
+        pthread_mutex_init(&a->lock, NULL);
+#endif
     }
-    heap_listp += (4 * NUMLIST) * WSIZE;
+    heap_listp += head;
     PUT(heap_listp, 0);                             /* Alignment padding */
-    PUT(heap_listp + 1 * WSIZE, PACK(DSIZE, 1));    /* Prologue header */ 
-    PUT(heap_listp + 2 * WSIZE, PACK(DSIZE, 1));    /* Prologue footer */ 
-    PUT(heap_listp + 3 * WSIZE, PACK(0, 1));        /* Epilogue header */  
+    PUT(heap_listp + 1 * WSIZE, PACK(DSIZE, 1));    /* Prologue header */
+    PUT(heap_listp + 2 * WSIZE, PACK(DSIZE, 1));    /* Prologue footer */
+    PUT(heap_listp + 3 * WSIZE, PACK(0, 1) | PREV_ALLOCATED); /* Epilogue header */
     heap_listp += 2 * WSIZE;
 
-    if (extend_heap(CHUNKSIZE) == NULL) return -1;
+    memset(slab_map, 0, (slab_bits + 7) >> 3);
+    slab_bits = 0;
+#ifdef MM_STATS
+    memset(&stats, 0, sizeof(stats));
+#endif
+
+    /* The first arena starts out with the prologue's chunk */
+    arenas->end = OFF(heap_listp + DSIZE);
+#ifdef MM_THREADS
+    memset(chunk_arena, 0, POS(PTR(arenas->end)) >> CHUNK_SHIFT);
+    heap_gen++;
+#endif
+    if (extend_heap(arenas, CHUNKSIZE) == NULL) return -1;
 
     return 0;
 }
 
-void *mm_malloc(size_t size) 
+void *mm_malloc(size_t size)
 {
-    size_t asize, extendsize;      /* Adjusted block size */
-    char *bp;      
-    /* Adjust block size to include overhead and alignment reqs. */
-    if(size <= DSIZE) {
-    	asize = 2*DSIZE;
+    size_t asize;      /* Adjusted block size */
+    arena_t *a = arenas;
+    char *bp;
+
+    STAT(mallocs, 1);
+    STAT(requested, size);
+    if (size >= MMAP_THRESHOLD) {
+        STAT(granted, PAGE_ROUND(size + MAP_HDR));
+        return map_alloc(size);
+    }
+    /* Adjust block size to include overhead and alignment reqs.
+       Slots need neither, so they are the only sizes up to SLAB_MAX. */
+    if(size <= SLAB_MAX) {
+    	asize = ALIGN(MAX(size, 1));
     } else {
         asize = DSIZE * ((size + OVERHEAD + (DSIZE-1)) / DSIZE);
     }
+    STAT(granted, asize);
 
-    /* Search the free list for a fit */
-    if ((bp = find_fit(asize)) != NULL) {
-        bp = place(bp, asize);
-        return bp;
-    }
+#ifdef MM_THREADS
+    tcache_t *tc = thread_cache();
 
-    // If there is no fit free block, extend the heap and place the block.
-    extendsize = MAX(asize, CHUNKSIZE);
-    if ((bp = extend_heap(extendsize)) == NULL) {
-            return NULL;
-    }
-    place(bp, asize);
+    if (asize <= TCACHE_MAX)
+        return tcache_get(tc, asize);
+    a = &arenas[tc->arena];
+#endif
+    LOCK(a);
+    bp = arena_malloc(a, asize);
+    UNLOCK(a);
     return bp;
 }
 
 void mm_free(void *bp)
 {
+    arena_t *a;
+
+    STAT(frees, 1);
     if(bp == NULL) return;
-    size_t size = SIZE(bp);
-    PUT(HDPT(bp), PACK(size, 0));
-    PUT(FTPT(bp), PACK(size, 0));
-    bp = insert(bp);
-    coalesce(bp);
+    if (IS_MAPPED(bp)) {
+        mem_unmap((char *)bp - MAP_HDR);
+        return;
+    }
+#ifdef MM_THREADS
+    size_t size = BLOCK_SIZE(bp);
+
+    if (size <= TCACHE_MAX) {
+        tcache_put(thread_cache(), bp, size);
+        return;
+    }
+#endif
+    a = OWNER(bp);
+    LOCK(a);
+    quick_free(a, bp);
+    UNLOCK(a);
+}
+
+/*
+ * mm_free_sized - mm_free for a block whose request size the caller
+ * knows. Above SLAB_MAX a heap block is at least as large as the block
+ * mm_malloc would carve for that size, so one of up to QUICK_MAX (or
+ * TCACHE_MAX) bytes goes on the quick list or tcache bin of that size
+ * without its header being read; its header stays right, GROWN bit
+ * and all. Larger blocks are freed as by mm_free. Whether a block is
+ * mapped is told by its address: realloc's slack can put a request
+ * below MMAP_THRESHOLD in a mapping.
+ */
+void mm_free_sized(void *bp, size_t size)
+{
+    size_t asize;
+    arena_t *a;
+
+    if (bp == NULL || size <= SLAB_MAX) {
+        mm_free(bp);            /* a slot, or a block realloc shrank */
+        return;
+    }
+    STAT(frees, 1);
+    if (IS_MAPPED(bp)) {
+        mem_unmap((char *)bp - MAP_HDR);
+        return;
+    }
+    asize = DSIZE * ((size + OVERHEAD + (DSIZE-1)) / DSIZE);
+#ifdef MM_THREADS
+    if (asize <= TCACHE_MAX) {
+        tcache_put(thread_cache(), bp, asize);
+        return;
+    }
+#endif
+    a = OWNER(bp);
+    LOCK(a);
+    if (asize <= QUICK_MAX)
+        quick_push(a, bp, asize);
+    else
+        arena_free(a, bp);
+    UNLOCK(a);
+}
+
+/*
+ * mm_malloc_batch - n blocks of size bytes under one lock and one size
+ * class lookup. Free blocks large enough for many of them are cut up
+ * in a single pass, and a miss grows the heap by all that is still
+ * wanted, up to MMAP_THRESHOLD bytes at a time.
+ */
+size_t mm_malloc_batch(size_t size, size_t n, void **out)
+{
+    size_t asize, got = 0, k;
+    arena_t *a = arenas;
+    char *bp;
+
+    STAT(mallocs, n);
+    STAT(requested, size * n);
+    if (size >= MMAP_THRESHOLD) {
+        while (got < n && (bp = map_alloc(size)) != NULL)
+            out[got++] = bp;
+        STAT(granted, PAGE_ROUND(size + MAP_HDR) * n);
+        return got;
+    }
+    if(size <= SLAB_MAX) {
+    	asize = ALIGN(MAX(size, 1));
+    } else {
+        asize = DSIZE * ((size + OVERHEAD + (DSIZE-1)) / DSIZE);
+    }
+    STAT(granted, asize * n);
+
+#ifdef MM_THREADS
+    tcache_t *tc = thread_cache();
+
+    if (asize <= TCACHE_MAX) {
+        while (got < n && (bp = tcache_get(tc, asize)) != NULL)
+            out[got++] = bp;
+        return got;
+    }
+    a = &arenas[tc->arena];
+#endif
+    LOCK(a);
+    if (asize <= SLAB_MAX) {
+        while (got < n && (bp = slab_alloc(a, asize)) != NULL)
+            out[got++] = bp;
+        UNLOCK(a);
+        return got;
+    }
+    if (asize <= QUICK_MAX) {
+        while (got < n && (bp = PTR(a->quick_head[asize / DSIZE])) != NULL) {
+            a->quick_head[asize / DSIZE] = GET(bp);
+            a->quick_bytes -= asize;
+            STAT(quick_hits, 1);
+            out[got++] = bp;
+        }
+    }
+    if (got < n && asize > QUICK_MAX && a->quick_bytes > 0)
+        consolidate(a);
+    while (got < n) {
+        k = MIN(n - got, MAX(MMAP_THRESHOLD / asize, 1));
+        if ((bp = find_fit(a, k * asize)) == NULL &&
+            (bp = find_fit(a, asize)) == NULL &&
+            (bp = extend_heap(a, MAX(k * asize, CHUNKSIZE))) == NULL)
+            break;
+        got += carve(a, bp, asize, k, out + got);
+    }
+    UNLOCK(a);
+    return got;
+}
+
+/*
+ * mm_free_batch - Free ptrs[0..n), which it sorts by address. A run of
+ * blocks that follow each other in the heap is freed as one block, so
+ * it is inserted into a free list and coalesced once, not per block.
+ * Runs of a single block take the path mm_free would.
+ */
+void mm_free_batch(void **ptrs, size_t n)
+{
+    arena_t *a, *locked = NULL;
+    char *bp;
+    size_t i, j, size;
+
+    qsort(ptrs, n, sizeof(void *), addr_cmp);
+    for (i = 0; i < n; i = j) {
+        bp = ptrs[i];
+        j = i + 1;
+        if (bp == NULL)
+            continue;
+        if (IS_MAPPED(bp)) {
+            STAT(frees, 1);
+            mem_unmap(bp - MAP_HDR);
+            continue;
+        }
+        size = 0;
+        if (!IN_SLAB(bp)) {
+            size = SIZE(bp);
+            while (j < n && ptrs[j] == bp + size && !IN_SLAB(ptrs[j]) &&
+                   size + SIZE(ptrs[j]) <= MAX_FREE)
+                size += SIZE(ptrs[j++]);
+        }
+        STAT(frees, j - i);
+#ifdef MM_THREADS
+        if (j == i + 1 && BLOCK_SIZE(bp) <= TCACHE_MAX) {
+            if (locked != NULL)
+                UNLOCK(locked);
+            locked = NULL;
+            tcache_put(thread_cache(), bp, BLOCK_SIZE(bp));
+            continue;
+        }
+#endif
+        a = OWNER(bp);
+        if (a != locked) {
+            if (locked != NULL)
+                UNLOCK(locked);
+            LOCK(a);
+            locked = a;
+        }
+        if (j == i + 1) {
+            quick_free(a, bp);
+        } else {
+            PUT_HDR(bp, size, 1);   /* the run, as one allocated block */
+            arena_free(a, bp);
+        }
+    }
+    if (locked != NULL)
+        UNLOCK(locked);
 }
 
+static int addr_cmp(const void *x, const void *y)
+{
+    char *p = *(char * const *)x, *q = *(char * const *)y;
+
+    return (p > q) - (p < q);
+}
+
+/*
+ * mm_realloc - Resize in place when the block is big enough, can take
+ * over free blocks behind it or ends the heap. A block that grows a
+ * second time gets RESERVE bytes of slack, so a buffer grown step by
+ * step is only moved now and then. Mapped blocks are remapped while
+ * they stay above MMAP_THRESHOLD.
+ */
 void *mm_realloc(void *ptr, size_t size)
 {
     size_t old_size;
-    size_t asize;
+    size_t asize, reserve = 0;
+    arena_t *a;
     void *newptr;
 
+    STAT(reallocs, 1);
     if(size == 0){
         mm_free(ptr);
         return NULL;
     }
     if(ptr == NULL)
         return mm_malloc(size);
-    old_size = SIZE(ptr);
-    asize = ALIGN(size + DSIZE);
-    if(old_size >= asize){
-        PUT(HDPT(ptr), PACK(old_size, 1));
-        PUT(FTPT(ptr), PACK(old_size, 1));
-        return ptr;
+    if (IS_MAPPED(ptr)) {
+        if (size >= MMAP_THRESHOLD)
+            return map_resize(ptr, size);
+        old_size = MAP_LEN(ptr) - MAP_HDR;
+    } else if (IN_SLAB(ptr)) {
+        old_size = RUN(ptr)->size;
+        if (size <= old_size)
+            return ptr;
     } else {
-        newptr = mm_malloc(size);
-        memcpy(newptr, ptr, size);
-        mm_free(ptr);
-        return newptr;
+        /* Frees next door rewrite the PREV_ALLOCATED bit of this
+           header under the arena lock, so read it under that lock too */
+        a = OWNER(ptr);
+        LOCK(a);
+        if (size < MMAP_THRESHOLD) {
+            asize = MAX(MIN_BLOCK, ALIGN(size + OVERHEAD));
+            newptr = arena_resize(a, ptr, asize);
+            if (newptr == NULL && a->quick_bytes > 0) {
+                consolidate(a);     /* a quick block may be in the way */
+                newptr = arena_resize(a, ptr, asize);
+            }
+            if (newptr != NULL) {
+                UNLOCK(a);
+                return newptr;
+            }
+        }
+        old_size = SIZE(ptr) - OVERHEAD;
+        if (IS_GROWN(ptr))
+            reserve = RESERVE(size);
+        UNLOCK(a);
+    }
+
+    if ((newptr = mm_malloc(size + reserve)) == NULL)
+        return NULL;
+    if (!IS_MAPPED(newptr) && !IN_SLAB(newptr)) {
+        a = OWNER(newptr);
+        LOCK(a);
+        SET_GROWN(newptr);
+        UNLOCK(a);
     }
+    memcpy(newptr, ptr, MIN(old_size, size));
+    mm_free(ptr);
+    return newptr;
 }
 
 void *calloc(size_t nmemb, size_t size){
         void *newptr;
 
+        STAT(callocs, 1);
         newptr = malloc(nmemb * size);
-        memset(newptr, 0, nmemb * size);
+        if (!IS_MAPPED(newptr))     /* fresh mappings are zeroed */
+                memset(newptr, 0, nmemb * size);
 
         return newptr;
 }
 
-static void *coalesce(void *bp) 
+/*
+ * map_alloc - A mapping of its own for a block of size bytes
+ */
+static void *map_alloc(size_t size)
+{
+    size_t len = PAGE_ROUND(size + MAP_HDR);
+    char *bp;
+
+    if ((bp = mem_map(len)) == NULL)
+        return NULL;
+    bp += MAP_HDR;
+    MAP_LEN(bp) = len;
+    PUT(HDPT(bp), MAPPED);
+    return bp;
+}
+
+/*
+ * map_resize - Remap the mapped block bp to hold size bytes
+ */
+static void *map_resize(char *bp, size_t size)
+{
+    size_t len = PAGE_ROUND(size + MAP_HDR);
+
+    if (len == MAP_LEN(bp))
+        return bp;
+    if ((bp = mem_remap(bp - MAP_HDR, len)) == NULL)
+        return NULL;
+    bp += MAP_HDR;
+    MAP_LEN(bp) = len;
+    return bp;
+}
+
+/*
+ * arena_malloc, arena_free - mm_malloc and mm_free on one arena, whose
+ * lock the caller holds
+ */
+static void *arena_malloc(arena_t *a, size_t asize)
+{
+    char *bp;
+
+    if (asize <= SLAB_MAX)
+        return slab_alloc(a, asize);
+    if (asize <= QUICK_MAX && (bp = PTR(a->quick_head[asize / DSIZE])) != NULL) {
+        a->quick_head[asize / DSIZE] = GET(bp);
+        a->quick_bytes -= asize;
+        STAT(quick_hits, 1);
+        return bp;
+    }
+    if (asize >= TREE_MIN && a->quick_bytes > 0)
+        consolidate(a);
+
+    /* Search the free list for a fit */
+    if ((bp = find_fit(a, asize)) != NULL)
+        return place(a, bp, asize);
+    if (a->quick_bytes > 0 && asize > QUICK_MAX) {
+        consolidate(a);
+        if ((bp = find_fit(a, asize)) != NULL)
+            return place(a, bp, asize);
+    }
+
+    // If there is no fit free block, extend the heap and place the block.
+    if ((bp = extend_heap(a, MAX(asize, CHUNKSIZE))) == NULL)
+        return NULL;
+    return place(a, bp, asize);
+}
+
+static void arena_free(arena_t *a, void *bp)
+{
+    size_t size;
+
+    if (IN_SLAB(bp)) {
+        slab_free(a, bp);
+        return;
+    }
+    size = SIZE(bp);
+
+    PUT_HDR(bp, size, 0);
+    PUT(FTPT(bp), PACK(size, 0));
+    CLEAR_PREV_ALLOC(NEXT_BLKP(bp));
+    bp = insert(a, bp);
+    bp = coalesce(a, bp);
+
+    /* Count what was freed, not what it coalesced into */
+    if (SIZE(bp) >= TREE_MIN && (a->freed += size) >= PURGE_BYTES) {
+        unsigned int now = now_ms();
+
+        trim_top(a, TOP_PAD, now, DECAY_MS);
+        purge(a->tree_root, now, DECAY_MS);
+        a->freed = 0;
+        a->epoch = now;
+    }
+}
+
+/*
+ * quick_free - Free bp onto its quick list if it is small enough,
+ * coalescing the quick lists once they hold QUICK_BYTES
+ */
+static void quick_free(arena_t *a, char *bp)
+{
+    size_t size;
+
+    if (IN_SLAB(bp) || (size = SIZE(bp)) > QUICK_MAX) {
+        arena_free(a, bp);
+        return;
+    }
+    PUT_HDR(bp, size, 1);       /* drops GROWN */
+    quick_push(a, bp, size);
+}
+
+/*
+ * quick_push - Push bp onto the quick list of blocks of size bytes,
+ * which bp is at least
+ */
+static void quick_push(arena_t *a, char *bp, size_t size)
+{
+    PUT(bp, a->quick_head[size / DSIZE]);
+    a->quick_head[size / DSIZE] = OFF(bp);
+    if ((a->quick_bytes += size) >= QUICK_BYTES)
+        consolidate(a);
+}
+
+/*
+ * consolidate - Free every block of the quick lists for real
+ */
+static void consolidate(arena_t *a)
+{
+    char *bp;
+    int i;
+
+    if (a->quick_bytes > 0)
+        STAT(consolidations, 1);
+    for (i = 0; i < QUICK_BINS; i++) {
+        while ((bp = PTR(a->quick_head[i])) != NULL) {
+            a->quick_head[i] = GET(bp);
+            arena_free(a, bp);
+        }
+    }
+    a->quick_bytes = 0;
+}
+
+/*
+ * mm_trim - Give back what the heap can spare: its top beyond pad
+ * bytes of free space, and the pages inside every free block of the
+ * tree. Returns the number of bytes released.
+ */
+size_t mm_trim(size_t pad)
+{
+    arena_t *a;
+    size_t released = 0;
+
+    unsigned int now = now_ms();
+
+    for (a = arenas; a < arenas + NARENAS; a++) {
+        LOCK(a);
+        consolidate(a);
+        released += trim_top(a, pad, now, 0);
+        released += purge(a->tree_root, now, 0);
+        a->freed = 0;
+        UNLOCK(a);
+    }
+    return released;
+}
+
+/*
+ * mm_stats - Fill st with the counters, if built with MM_STATS, and
+ * with what the free lists, the tree and the quick lists of every
+ * arena hold. Quick blocks count apart: they are free only to their
+ * own size.
+ */
+void mm_stats(mm_stats_t *st)
+{
+    arena_t *a;
+    char *bp;
+    int i;
+
+#ifdef MM_STATS
+    *st = stats;
+    st->counted = 1;
+#else
+    memset(st, 0, sizeof(*st));
+#endif
+    memset(st->list_blocks, 0, sizeof(st->list_blocks));
+    memset(st->list_bytes, 0, sizeof(st->list_bytes));
+    st->tree_blocks = st->quick_blocks = 0;
+    st->tree_bytes = st->quick_bytes = st->free_bytes = st->largest_free = 0;
+    st->nclasses = NUMLIST;
+
+    for (a = arenas; a != NULL && a < arenas + NARENAS; a++) {
+        LOCK(a);
+        for (i = 0; i < NUMLIST; i++) {
+            for (bp = HEAD(a, i); bp != NULL; bp = NEXT(bp)) {
+                st->list_blocks[i]++;
+                st->list_bytes[i] += SIZE(bp);
+                st->largest_free = MAX(st->largest_free, SIZE(bp));
+            }
+            st->free_bytes += st->list_bytes[i];
+        }
+        for (i = 0; i < QUICK_BINS; i++) {
+            for (bp = PTR(a->quick_head[i]); bp != NULL; bp = PTR(GET(bp))) {
+                st->quick_blocks++;
+                st->quick_bytes += SIZE(bp);
+            }
+        }
+        tree_stats(a->tree_root, st);
+        UNLOCK(a);
+    }
+    st->heap_bytes = mem_heapsize();
+    st->mapped_bytes = mem_mapsize();
+    st->internal = st->granted ? 1 - (double)st->requested / st->granted : 0;
+    st->external = st->free_bytes ? 1 - (double)st->largest_free / st->free_bytes : 0;
+}
+
+/*
+ * tree_stats - Add the blocks of the subtree at off to st
+ */
+static void tree_stats(unsigned int off, mm_stats_t *st)
+{
+    char *bp = PTR(off);
+
+    if (bp == NULL)
+        return;
+    tree_stats(LEFT(bp), st);
+    tree_stats(RIGHT(bp), st);
+    st->tree_blocks++;
+    st->tree_bytes += SIZE(bp);
+    st->free_bytes += SIZE(bp);
+    st->largest_free = MAX(st->largest_free, SIZE(bp));
+}
+
+#ifdef MM_STATS
+/*
+ * probe_bucket - Bucket of a search that looked at probes blocks:
+ * 0, 1, 2-3, 4-7, ... up to MM_STAT_PROBES - 1
+ */
+static int probe_bucket(int probes)
+{
+    if (probes == 0)
+        return 0;
+    return MIN(32 - __builtin_clz(probes), MM_STAT_PROBES - 1);
+}
+#endif
+
+static unsigned int now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * trim_top - Lower the break so that the free block ending the heap,
+ * if arena a has it and it has been free for delay ms, keeps only pad
+ * bytes. Returns the bytes cut. Not with MM_THREADS: another thread
+ * could be growing the heap.
+ */
+static size_t trim_top(arena_t *a, size_t pad, unsigned int now, unsigned int delay)
+{
+#ifndef MM_THREADS
+    char *end = PTR(a->end);
+    char *bp;
+    size_t size, cut;
+
+    if (GET_PREV_ALLOC(HDPT(end)) || (char *)mem_heap_hi() + 1 != end)
+        return 0;
+    bp = PREV_BLKP(end);
+    size = SIZE(bp);
+    pad = MAX(ALIGN(pad), 2 * DSIZE);
+    if (size <= pad || (delay > 0 && size < TRIM_THRESHOLD))
+        return 0;
+    if (size >= TREE_MIN && FREED_AT(bp) != RELEASED && now - FREED_AT(bp) < delay)
+        return 0;
+    cut = size - pad;
+    delete(a, bp);
+    if (mem_sbrk(-(intptr_t)cut) == (void *)-1) {
+        insert(a, bp);
+        return 0;
+    }
+    a->end = OFF(end - cut);
+    PUT_HDR(bp, pad, 0);
+    PUT(FTPT(bp), PACK(pad, 0));
+    PUT(HDPT(NEXT_BLKP(bp)), PACK(0, 1));   /* New epilogue header */
+    insert(a, bp);
+    return cut;
+#else
+    return 0;
+#endif
+}
+
+/*
+ * purge - Release the pages inside the free blocks of the subtree at
+ * off that have been free for delay ms and not released yet. The
+ * links, time stamp and footer stay mapped.
+ */
+static size_t purge(unsigned int off, unsigned int now, unsigned int delay)
+{
+    char *bp = PTR(off);
+    size_t released;
+
+    if (bp == NULL)
+        return 0;
+    released = purge(LEFT(bp), now, delay) + purge(RIGHT(bp), now, delay);
+    if (FREED_AT(bp) != RELEASED && now - FREED_AT(bp) >= delay) {
+        released += mem_release(bp + 2 * DSIZE, SIZE(bp) - 3 * DSIZE);
+        FREED_AT(bp) = RELEASED;
+    }
+    return released;
+}
+
+#ifdef MM_THREADS
+static void tcache_destroy(void *arg)
+{
+    tcache_t *tc = arg;
+    int i;
+
+    if (tc->gen != heap_gen)
+        return;
+    for (i = 0; i < TCACHE_BINS; i++)
+        tcache_drain(tc, i, tc->count[i]);
+}
+
+static void tcache_key_create(void)
+{
+    pthread_key_create(&tcache_key, tcache_destroy);
+}
+
+/*
+ * thread_cache - The calling thread's cache, emptied and given the
+ * next arena the first time the thread calls in after mm_init
+ */
+static tcache_t *thread_cache(void)
 {
-    size_t prev_alloc = GET_ALLOC(FTPT(PREV_BLKP(bp)));
-    size_t next_alloc = GET_ALLOC(HDPT(NEXT_BLKP(bp)));
+    if (tcache.gen != heap_gen) {
+        memset(&tcache, 0, sizeof(tcache));
+        tcache.gen = heap_gen;
+        tcache.arena = __atomic_fetch_add(&next_arena, 1, __ATOMIC_RELAXED) % NARENAS;
+        pthread_once(&tcache_once, tcache_key_create);
+        pthread_setspecific(tcache_key, &tcache);
+    }
+    return &tcache;
+}
+
+/*
+ * tcache_get - Pop a block of asize bytes, refilling an empty bin with
+ * up to TCACHE_FILL blocks under a single lock of the thread's arena
+ */
+static void *tcache_get(tcache_t *tc, size_t asize)
+{
+    int i = asize / DSIZE;
+    arena_t *a;
+    char *bp;
+    int n;
+
+    if (tc->bin[i] == NULL) {
+        a = &arenas[tc->arena];
+        LOCK(a);
+        for (n = 0; n < TCACHE_FILL; n++) {
+            if ((bp = arena_malloc(a, asize)) == NULL)
+                break;
+            *(char **)bp = tc->bin[i];
+            tc->bin[i] = bp;
+            tc->count[i]++;
+        }
+        UNLOCK(a);
+        if (tc->bin[i] == NULL)
+            return NULL;
+    }
+    bp = tc->bin[i];
+    tc->bin[i] = *(char **)bp;
+    tc->count[i]--;
+    return bp;
+}
+
+/*
+ * tcache_put - Push a freed block of at least size bytes, first
+ * handing half of a full bin back to the arenas
+ */
+static void tcache_put(tcache_t *tc, char *bp, size_t size)
+{
+    int i = size / DSIZE;
+
+    if (tc->count[i] == TCACHE_COUNT)
+        tcache_drain(tc, i, TCACHE_COUNT / 2);
+    *(char **)bp = tc->bin[i];
+    tc->bin[i] = bp;
+    tc->count[i]++;
+}
+
+/*
+ * tcache_drain - Free n blocks of bin i in their own arenas, keeping a
+ * lock across blocks of the same arena
+ */
+static void tcache_drain(tcache_t *tc, int i, int n)
+{
+    arena_t *a, *locked = NULL;
+    char *bp;
+
+    while (n-- > 0 && (bp = tc->bin[i]) != NULL) {
+        tc->bin[i] = *(char **)bp;
+        tc->count[i]--;
+        a = OWNER(bp);
+        if (a != locked) {
+            if (locked != NULL)
+                UNLOCK(locked);
+            LOCK(a);
+            locked = a;
+        }
+        quick_free(a, bp);
+    }
+    if (locked != NULL)
+        UNLOCK(locked);
+}
+#endif
+
+static void *coalesce(arena_t *a, void *bp)
+{
+    size_t prev_alloc = PREV_ALLOC(bp);
+    size_t next_alloc = ALLOC(NEXT_BLKP(bp));
     size_t size = SIZE(bp);
 
+    /* Leave a neighbour apart rather than overflow the header */
+    if (!next_alloc && size + NEXT_SIZE(bp) > MAX_FREE)
+        next_alloc = 1;
+    if (!prev_alloc && size + PREV_SIZE(bp) + (next_alloc ? 0 : NEXT_SIZE(bp)) > MAX_FREE)
+        prev_alloc = 1;
+
     if (prev_alloc && next_alloc) {            //if prev and next blocks are both allocated
         return bp;
     } else if (prev_alloc && !next_alloc) {    //if prev is allocated but next is free
+        STAT(coalesces, 1);
         size += SIZE(NEXT_BLKP(bp));
-        delete(NEXT_BLKP(bp));
-        delete(bp);
-        PUT(HDPT(bp), PACK(size, 0));
+        delete(a, NEXT_BLKP(bp));
+        delete(a, bp);
+        PUT_HDR(bp, size, 0);
         PUT(FTPT(bp), PACK(size,0));
-        insert(bp);
+        insert(a, bp);
     } else if (!prev_alloc && next_alloc) {    //if prev is free but next is allocated
+        STAT(coalesces, 1);
         size += SIZE(PREV_BLKP(bp));
-        delete(PREV_BLKP(bp));
-        delete(bp);
+        delete(a, PREV_BLKP(bp));
+        delete(a, bp);
         PUT(FTPT(bp), PACK(size, 0));
-        PUT(HDPT(PREV_BLKP(bp)), PACK(size, 0));
+        PUT_HDR(PREV_BLKP(bp), size, 0);
         bp = PREV_BLKP(bp);
-        insert(bp);
+        insert(a, bp);
     } else {                                     //if both are free
+        STAT(coalesces, 2);
         size += GET_SIZE(HDPT(PREV_BLKP(bp))) + GET_SIZE(FTPT(NEXT_BLKP(bp)));
-        delete(bp);
-        delete(NEXT_BLKP(bp));
-        delete(PREV_BLKP(bp));
-        PUT(HDPT(PREV_BLKP(bp)), PACK(size, 0));
+        delete(a, bp);
+        delete(a, NEXT_BLKP(bp));
+        delete(a, PREV_BLKP(bp));
+        PUT_HDR(PREV_BLKP(bp), size, 0);
         PUT(FTPT(NEXT_BLKP(bp)), PACK(size, 0));
         bp = PREV_BLKP(bp);
-        insert(bp);
+        insert(a, bp);
     }
 
     return bp;
 }
 
-static void* place(void *bp, size_t asize)
+static void* place(arena_t *a, void *bp, size_t asize)
 {
     size_t csize = SIZE(bp);
-    
-    delete(bp);
+
+    STAT(places, 1);
+    delete(a, bp);
     if ((csize - asize) >= 2 * DSIZE) {
-        PUT(HDPT(bp), PACK(asize, 1));
-        PUT(FTPT(bp), PACK(asize, 1));
+        STAT(splits, 1);
+        PUT_HDR(bp, asize, 1);
         void* next_free_p = NEXT_BLKP(bp);
-        PUT(HDPT(next_free_p), PACK(csize - asize, 0));
+        PUT(HDPT(next_free_p), PACK(csize - asize, 0) | PREV_ALLOCATED);
         PUT(FTPT(next_free_p), PACK(csize - asize, 0));
-        insert(next_free_p);
-    } else { 
-        PUT(HDPT(bp), PACK(csize, 1));
-        PUT(FTPT(bp), PACK(csize, 1));
+        insert(a, next_free_p);
+    } else {
+        PUT_HDR(bp, csize, 1);
+        SET_PREV_ALLOC(NEXT_BLKP(bp));
     }
 
     return bp;
 }
 
-static int get_index(size_t size)
+/*
+ * carve - Cut up to k allocated blocks of asize bytes, into out[], off
+ * the front of free block bp, which holds at least one; what is left
+ * stays free, or goes to the last block if it is too small for a
+ * block of its own. Returns how many were cut.
+ */
+static size_t carve(arena_t *a, char *bp, size_t asize, size_t k, void **out)
 {
-    int index = 0;
-    int bound = (1<<4);
+    size_t csize = SIZE(bp);
+    size_t i, rest;
 
-    while ((index < NUMLIST - 1)){
-    	if (size < bound)
-    		return index;
-    	bound <<= 1;
-    	index++;
+    STAT(places, 1);
+    delete(a, bp);
+    k = MIN(k, csize / asize);
+    rest = csize - k * asize;
+    PUT_HDR(bp, asize, 1);
+    for (i = 0; i < k; i++) {
+        out[i] = bp;
+        if (i > 0)
+            PUT(HDPT(bp), PACK(asize, 1) | PREV_ALLOCATED);
+        bp += asize;
+    }
+    if (rest >= 2 * DSIZE) {
+        STAT(splits, k);
+        PUT(HDPT(bp), PACK(rest, 0) | PREV_ALLOCATED);
+        PUT(FTPT(bp), PACK(rest, 0));
+        insert(a, bp);
+    } else {
+        STAT(splits, k - 1);
+        bp = out[k - 1];
+        PUT_HDR(bp, asize + rest, 1);
+        SET_PREV_ALLOC(NEXT_BLKP(bp));
     }
+    return k;
+}
 
-    return NUMLIST-1;
+/*
+ * get_index - Size class of a block below TREE_MIN, looked up in the
+ * table mkclasses fitted to the traces
+ */
+static int get_index(size_t size)
+{
+    return class_of[size >> 3];
 }
 
-// first-fist policy
-static void* find_fit(size_t asize)
+/*
+ * find_fit - First fit in the request's own list, then any block of
+ * the next non-empty list, then the best fit in the tree
+ */
+static void* find_fit(arena_t *a, size_t asize)
 {
     void *curr;
-    int index;
+    int index, probes = 0;
+    unsigned long map;
 
-    for (index = get_index(asize); index < NUMLIST; index++){
-        if ((void*)free_head[index] == NULL)
-            continue;
-        for (curr = (char*)free_head[index]; curr != (void*)free_tail[index]; curr = NEXT(curr)){
-            if (SIZE(curr) >= asize)
+    STAT(fits, 1);
+    if (asize < TREE_MIN) {
+        /* Blocks in the request's own class may still be too small */
+        index = get_index(asize);
+        for (curr = HEAD(a, index); curr != NULL; curr = NEXT(curr)) {
+            probes++;
+            if (SIZE(curr) >= asize) {
+                STAT_PROBES(probes);
                 return curr;
-        }
-        if (SIZE(curr) >= asize)
-            return curr;
-    }
-    return NULL;
-}
-
-static void* insert(void* bp)
-{
-    int index = get_index(SIZE(bp));
-    char *curr = (char *)free_head[index];
-
-    if ((void*)free_head[index] == NULL){
-        free_head[index] = (size_t)bp;
-        free_tail[index] = (size_t)bp;
-    } else{
-        if (free_head[index] > (size_t)bp){
-            PUT_NEXT(bp, free_head[index]);
-            PUT_PREV(free_head[index], bp);
-            free_head[index] = (size_t)bp;
-        } else if (free_tail[index] < (size_t)bp){
-            PUT_NEXT(free_tail[index],bp);
-            PUT_PREV(bp,free_tail[index]);
-            free_tail[index] = (size_t)bp;
-        } else{
-            while (NEXT(curr) < (char*)bp){
-                curr = NEXT(curr);
             }
-            char* nextBp = NEXT(curr);
-            PUT_PREV(nextBp,bp);
-            PUT_NEXT(curr,bp);
-            PUT_NEXT(bp,nextBp);
-            PUT_PREV(bp,curr);
+        }
+
+        /* Every block of a larger class fits */
+        map = a->free_map & (~1UL << index);
+        if (map != 0) {
+            STAT_PROBES(probes + 1);
+            return HEAD(a, __builtin_ctzl(map));
+        }
+    }
+    curr = tree_fit(a, asize, &probes);
+    STAT_PROBES(probes);
+    return curr;
+}
+
+static void* insert(arena_t *a, void* bp)
+{
+    int index;
+    char *head;
+
+    STAT(inserts, 1);
+    if (SIZE(bp) >= TREE_MIN) {
+        FREED_AT(bp) = a->epoch;
+        tree_insert(&a->tree_root, bp);
+        return bp;
+    }
+    index = get_index(SIZE(bp));
+    head = HEAD(a, index);
+    PUT_PREV(bp, NULL);
+    PUT_NEXT(bp, head);
+    if (head != NULL)
+        PUT_PREV(head, bp);
+    PUT_HEAD(a, index, bp);
+    a->free_map |= 1UL << index;
+    return bp;
+}
+
+static void delete(arena_t *a, void *bp)
+{
+    int index;
+    char *prev, *next;
+
+    STAT(deletes, 1);
+    if (SIZE(bp) >= TREE_MIN) {
+        tree_delete(&a->tree_root, bp);
+        return;
+    }
+    index = get_index(SIZE(bp));
+    prev = PREV(bp);
+    next = NEXT(bp);
+    if (prev != NULL)
+        PUT_NEXT(prev, next);
+    else
+        PUT_HEAD(a, index, next);
+    if (next != NULL)
+        PUT_PREV(next, prev);
+    if (a->free_head[index] == 0)
+        a->free_map &= ~(1UL << index);
+}
+
+/*
+ * rotate_left, rotate_right - Lift the right (left) child of the node
+ * at *link into its place
+ */
+static void rotate_left(unsigned int *link)
+{
+    char *node = PTR(*link);
+    char *child = PTR(RIGHT(node));
+
+    RIGHT(node) = LEFT(child);
+    LEFT(child) = OFF(node);
+    *link = OFF(child);
+}
+
+static void rotate_right(unsigned int *link)
+{
+    char *node = PTR(*link);
+    char *child = PTR(LEFT(node));
+
+    LEFT(node) = RIGHT(child);
+    RIGHT(child) = OFF(node);
+    *link = OFF(child);
+}
+
+/*
+ * tree_insert - Insert bp below the link, then rotate it up while its
+ * priority beats its parent's
+ */
+static void tree_insert(unsigned int *link, char *bp)
+{
+    char *node = PTR(*link);
+
+    if (node == NULL) {
+        LEFT(bp) = RIGHT(bp) = 0;
+        *link = OFF(bp);
+    } else if (LESS(bp, node)) {
+        tree_insert(&LEFT(node), bp);
+        if (PRIO(PTR(LEFT(node))) > PRIO(node))
+            rotate_right(link);
+    } else {
+        tree_insert(&RIGHT(node), bp);
+        if (PRIO(PTR(RIGHT(node))) > PRIO(node))
+            rotate_left(link);
+    }
+}
+
+/*
+ * tree_delete - Find bp below the link, rotate it down until it has at
+ * most one child, then splice it out. SIZE(bp) must still be its key.
+ */
+static void tree_delete(unsigned int *link, char *bp)
+{
+    char *node = PTR(*link);
+
+    if (node != bp) {
+        tree_delete(LESS(bp, node) ? &LEFT(node) : &RIGHT(node), bp);
+    } else if (LEFT(node) == 0) {
+        *link = RIGHT(node);
+    } else if (RIGHT(node) == 0) {
+        *link = LEFT(node);
+    } else if (PRIO(PTR(LEFT(node))) > PRIO(PTR(RIGHT(node)))) {
+        rotate_right(link);
+        tree_delete(&RIGHT(PTR(*link)), bp);
+    } else {
+        rotate_left(link);
+        tree_delete(&LEFT(PTR(*link)), bp);
+    }
+}
+
+/*
+ * tree_fit - Best fit: the smallest block of at least asize bytes,
+ * the lowest addressed one among equals; adds the nodes it visits to
+ * *probes
+ */
+static void *tree_fit(arena_t *a, size_t asize, int *probes)
+{
+    char *node = PTR(a->tree_root);
+    char *best = NULL;
+
+    while (node != NULL) {
+        (*probes)++;
+        if (SIZE(node) >= asize) {
+            best = node;
+            node = PTR(LEFT(node));
+        } else {
+            node = PTR(RIGHT(node));
         }
     }
+    return best;
+}
+
+/*
+ * place_aligned - Allocate a block of asize bytes whose payload is a
+ * multiple of align bytes from the heap base, freeing what is left
+ * over in front of and behind it
+ */
+static void *place_aligned(arena_t *a, size_t asize, size_t align)
+{
+    char *bp, *q;
+    size_t size, lead;
+
+    if ((bp = arena_malloc(a, asize + align + 2 * DSIZE)) == NULL)
+        return NULL;
+    q = heap_base + ((POS(bp) + align - 1) & ~(align - 1));
+    if (q != bp && q - bp < 2 * DSIZE)
+        q += align;             /* the lead must make a block of its own */
+    size = SIZE(bp);
+    lead = q - bp;
+    if (lead > 0) {
+        PUT_HDR(bp, lead, 1);
+        PUT(HDPT(q), PACK(size - lead, 1) | PREV_ALLOCATED);
+        arena_free(a, bp);
+        size -= lead;
+    }
+    if (size - asize >= 2 * DSIZE)
+        split_tail(a, q, asize);
+    return q;
+}
+
+/*
+ * split_tail - Cut allocated block bp down to asize bytes and free the
+ * rest, which coalesces with what follows
+ */
+static void split_tail(arena_t *a, char *bp, size_t asize)
+{
+    size_t size = SIZE(bp);
+    char *rest;
+
+    STAT(splits, 1);
+    PUT_HDR(bp, asize, 1);
+    rest = NEXT_BLKP(bp);
+    PUT(HDPT(rest), PACK(size - asize, 1) | PREV_ALLOCATED);
+    arena_free(a, rest);
+}
+
+/*
+ * arena_resize - Make allocated block bp asize bytes without moving
+ * it, or return NULL. Growing takes over the free blocks behind bp,
+ * extending the heap if bp is the last block of the arena, and aims
+ * for RESERVE bytes more than asked for if bp grew before; shrinking
+ * frees the tail.
+ */
+static void *arena_resize(arena_t *a, char *bp, size_t asize)
+{
+    size_t size = SIZE(bp);
+    size_t want = asize;
+    char *next;
+
+    if (size < asize) {
+        if (IS_GROWN(bp))
+            want = ALIGN(asize + RESERVE(asize));
+        for (next = NEXT_BLKP(bp); size < want; next = NEXT_BLKP(next)) {
+            if (next == PTR(a->end) && extend_heap(a, MAX(want - size, 2 * DSIZE)) != next)
+                break;          /* another arena's chunk got in between */
+            if (ALLOC(next) || size + SIZE(next) > MAX_FREE)
+                break;
+            size += SIZE(next);
+        }
+        if (size < asize)
+            return NULL;
+
+        /* Absorb the free blocks counted above */
+        while (SIZE(bp) < size) {
+            next = NEXT_BLKP(bp);
+            delete(a, next);
+            PUT_HDR(bp, SIZE(bp) + SIZE(next), 1);
+        }
+        SET_PREV_ALLOC(NEXT_BLKP(bp));
+        SET_GROWN(bp);
+        asize = MIN(size, want);
+    }
+    if (size - asize >= 2 * DSIZE)
+        split_tail(a, bp, asize);
     return bp;
 }
 
-static void delete(void *bp)
+/*
+ * slab_alloc - Take the lowest free slot of the first run of its size
+ * with one, starting a run if there is none
+ */
+static void *slab_alloc(arena_t *a, size_t ssize)
+{
+    int c = ssize / DSIZE - 1;
+    int nslots = (RUN_SIZE - RUN_HDR) / ssize;
+    run_t *run = RUN_PTR(a->slab_head[c]);
+    unsigned int bit, old;
+    int i;
+
+    if (run == NULL) {
+        if ((run = place_aligned(a, RUN_SIZE + DSIZE, RUN_SIZE)) == NULL)
+            return NULL;
+        run->free = (nslots < 32) ? (1U << nslots) - 1 : ~0U;
+        run->prev = run->next = 0;
+        run->size = ssize;
+        a->slab_head[c] = OFF(run);
+        bit = SLAB_BIT(run);
+        __atomic_fetch_or(&slab_map[bit >> 3], 1 << (bit & 7), __ATOMIC_RELAXED);
+        old = __atomic_load_n(&slab_bits, __ATOMIC_RELAXED);
+        while (bit >= old && !__atomic_compare_exchange_n(&slab_bits, &old,
+                    bit + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            ;                   /* runs of other arenas raise it too */
+    }
+    i = __builtin_ctz(run->free);
+    run->free &= run->free - 1;
+    if (run->free == 0) {
+        /* Full runs leave the list */
+        a->slab_head[c] = run->next;
+        if (run->next != 0)
+            RUN_PTR(run->next)->prev = 0;
+    }
+    return (char *)run + RUN_HDR + i * ssize;
+}
+
+/*
+ * slab_free - Set the slot's bit again. A run that fills up again goes
+ * back on its list; one that empties is freed unless it is the last
+ * run of its size with free slots.
+ */
+static void slab_free(arena_t *a, char *bp)
 {
-    int index = get_index(SIZE(bp));
+    run_t *run = RUN(bp);
+    int c = run->size / DSIZE - 1;
+    int nslots = (RUN_SIZE - RUN_HDR) / run->size;
+    unsigned int all = (nslots < 32) ? (1U << nslots) - 1 : ~0U;
+    unsigned int bit;
 
-    if (free_head[index] == free_tail[index])
-    	free_head[index] = free_tail[index] = (size_t)NULL;
-    else if (free_head[index] == (size_t)(bp))
-    	free_head[index] = (size_t)NEXT(bp);
-    else if (free_tail[index] == (size_t)(bp))
-    	free_tail[index] = (size_t)PREV(bp);
-    else {
-    	PUT_PREV(NEXT(bp), PREV(bp));
-    	PUT_NEXT(PREV(bp), NEXT(bp));
+    if (run->free == 0) {
+        run->prev = 0;
+        run->next = a->slab_head[c];
+        if (run->next != 0)
+            RUN_PTR(run->next)->prev = OFF(run);
+        a->slab_head[c] = OFF(run);
     }
+    run->free |= 1U << ((bp - (char *)run - RUN_HDR) / run->size);
+    if (run->free != all || (run->prev == 0 && run->next == 0))
+        return;
+
+    if (run->prev != 0)
+        RUN_PTR(run->prev)->next = run->next;
+    else
+        a->slab_head[c] = run->next;
+    if (run->next != 0)
+        RUN_PTR(run->next)->prev = run->prev;
+    bit = SLAB_BIT(run);
+    __atomic_fetch_and(&slab_map[bit >> 3], ~(1 << (bit & 7)), __ATOMIC_RELAXED);
+    arena_free(a, run);
 }
 
-static void *extend_heap(size_t words) 
+/*
+ * extend_heap - Grow arena a by a free block of at least words bytes.
+ * Memory contiguous with the arena's last chunk takes over its
+ * epilogue; otherwise another arena grew in between and the new
+ * memory becomes a chunk of its own, fenced by a prologue and an
+ * epilogue so that coalescing never crosses into a neighbour.
+ */
+static void *extend_heap(arena_t *a, size_t words)
 {
     char *bp;
+    size_t size;
 
     /* Allocate an even number of words to maintain alignment */
-    words = (words % 2) ? (words+1): words; 
-    if ((long)(bp = mem_sbrk(words)) == -1)  
-        return NULL;                                        
+    words = (words % 2) ? (words+1): words;
+#ifdef MM_THREADS
+    words = (words + 4 * WSIZE + CHUNK_GRAIN - 1) & ~(CHUNK_GRAIN - 1);
+#endif
+    if (POS(mem_heap_hi()) + 1 + words > HEAP_REACH)
+        return NULL;    /* beyond what an offset can name */
+    if ((long)(bp = mem_sbrk(words)) == -1)
+        return NULL;
+#ifdef MM_THREADS
+    memset(chunk_arena + (POS(bp) >> CHUNK_SHIFT), a - arenas, words >> CHUNK_SHIFT);
+#endif
+
+    size = words;
+    if (bp != PTR(a->end)) {
+        PUT(bp, 0);                                 /* Alignment padding */
+        PUT(bp + 1 * WSIZE, PACK(DSIZE, 1));        /* Prologue header */
+        PUT(bp + 2 * WSIZE, PACK(DSIZE, 1));        /* Prologue footer */
+        bp += 4 * WSIZE;
+        size -= 4 * WSIZE;
+        PUT(HDPT(bp), PREV_ALLOCATED);
+    }
+    a->end = OFF(bp + size);
+    STAT(extends, 1);
+    STAT(extend_bytes, words);
 
     /* Initialize free block header/footer and the epilogue header */
-    PUT(HDPT(bp), PACK(words, 0));         /* Free block header */   
-    PUT(FTPT(bp), PACK(words, 0));         /* Free block footer */   
-    PUT(HDPT(NEXT_BLKP(bp)), PACK(0, 1)); /* New epilogue header */ 
+    PUT_HDR(bp, size, 0);                 /* Free block header */
+    PUT(FTPT(bp), PACK(size, 0));         /* Free block footer */
+    PUT(HDPT(NEXT_BLKP(bp)), PACK(0, 1)); /* New epilogue header */
 
     /* Coalesce if the previous block was free */
-    return insert(bp);
+    return insert(a, bp);
 }
 
 // below are potentially useful debugging functions
@@ -334,17 +1553,17 @@ void mm_checkheap(int verbose)
     for (; i<NUMLIST; i++)
     {
         printf("size %d\n",i);
-        if (free_head[i] == (size_t)NULL){
+        if (HEAD(arenas, i) == NULL){
             printf("NULL\n");
             continue;
-        } 
-        for (curr = (char*)free_head[i]; curr != (char*)free_tail[i]; curr = NEXT(curr)){
+        }
+        for (curr = HEAD(arenas, i); curr != NULL; curr = NEXT(curr)){
             printf("SIZE :%u , ALLOC: %d\n", SIZE(curr), ALLOC(curr));
         }
-        printf("SIZE :%u , ALLOC: %d\n\n", SIZE(curr), ALLOC(curr));
+        printf("\n");
     }
     printf("\nheap block:\n");
     for (curr = heap_listp; curr != mem_heap_hi(); curr = NEXT_BLKP(curr)){
         printf("SIZE :%u , ALLOC: %d\n\n", SIZE(curr), ALLOC(curr));
     } */
-}
\ No newline at end of file
+}
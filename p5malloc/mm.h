@@ -6,6 +6,59 @@ extern void *mm_realloc(void *ptr, size_t size);
 extern void *mm_calloc (size_t nmemb, size_t size);
 extern int mm_init(void);
 
+/* Allocate n blocks of size bytes into out[0..n), carved from as few
+   free blocks as will hold them; returns how many it allocated */
+extern size_t mm_malloc_batch(size_t size, size_t n, void **out);
+
+/* Free ptrs[0..n), sorting them by address so that neighbours are
+   merged before they reach the free lists */
+extern void mm_free_batch(void **ptrs, size_t n);
+
+/* Free ptr, which was last allocated or reallocated with size bytes */
+extern void mm_free_sized(void *ptr, size_t size);
+
+/* Give free memory back to the system, keeping pad bytes at the top
+   of the heap; returns the number of bytes released */
+extern size_t mm_trim(size_t pad);
+
+/* What the allocator has done since mm_init, and what its free lists
+   hold now. The counters are only kept when mm.c is built with
+   -DMM_STATS (counted is set then); the rest is read off the free
+   lists by every call. */
+#define MM_STAT_CLASSES 64	/* list classes reported, at least NUMLIST */
+#define MM_STAT_PROBES  12	/* probe buckets: 0, 1, 2-3, 4-7, ... */
+
+typedef struct mm_stats {
+    int counted;                /* built with MM_STATS */
+
+    /* Calls, the public ones first; a calloc is also a malloc */
+    unsigned long mallocs, frees, reallocs, callocs;
+    unsigned long fits;         /* find_fit searches */
+    unsigned long places, inserts, deletes;
+    unsigned long splits;       /* blocks cut in two to fit a request */
+    unsigned long coalesces;    /* free neighbours merged */
+    unsigned long quick_hits;   /* requests served from a quick list */
+    unsigned long consolidations;
+    unsigned long extends;      /* times the heap grew */
+    size_t extend_bytes;
+    unsigned long probes[MM_STAT_PROBES]; /* searches by blocks looked at */
+    size_t requested, granted;  /* payload asked for, blocks handed out */
+
+    /* The free lists now */
+    int nclasses;
+    unsigned long list_blocks[MM_STAT_CLASSES];
+    size_t list_bytes[MM_STAT_CLASSES];
+    unsigned long tree_blocks, quick_blocks;
+    size_t tree_bytes, quick_bytes;
+    size_t free_bytes, largest_free;
+    size_t heap_bytes, mapped_bytes;
+
+    double internal;            /* 1 - requested / granted */
+    double external;            /* 1 - largest_free / free_bytes */
+} mm_stats_t;
+
+extern void mm_stats(mm_stats_t *st);
+
 /* This is largely for debugging.  You can do what you want with the
    verbose flag; we don't care. */
 extern void mm_checkheap(int verbose);
@@ -0,0 +1,174 @@
+/*
+ * mtbench.c - Multithreaded throughput of mm.c built with -DMM_THREADS
+ *
+ * Every thread runs the same random mix of mallocs and frees of small
+ * blocks over a private table of slots, checking that each block still
+ * holds the pattern written into it when it is freed. At the end each
+ * thread frees the blocks its neighbour left behind, so frees of blocks
+ * allocated by another thread are exercised too. The run is repeated
+ * for 1, 2, ... up to the requested number of threads.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#define MAX_THREADS 64
+#define SLOTS       1024	/* live blocks per thread, at most */
+
+typedef struct {
+    int id;
+    long ops;
+    size_t max_size;
+    char *ptr[SLOTS];
+    size_t size[SLOTS];
+    int errors;
+} worker_t;
+
+static worker_t workers[MAX_THREADS];
+static int nthreads;
+static pthread_barrier_t barrier;
+
+/*
+ * check_block - Does the block still hold the pattern of its slot?
+ */
+static int check_block(worker_t *w, int i)
+{
+    unsigned char c = (unsigned char)(w->id * SLOTS + i);
+
+    return w->ptr[i][0] == (char)c && w->ptr[i][w->size[i] - 1] == (char)c;
+}
+
+static void *worker(void *arg)
+{
+    worker_t *w = arg;
+    worker_t *left = &workers[(w->id + nthreads - 1) % nthreads];
+    unsigned int seed = w->id + 1;
+    long n;
+    int i;
+
+    for (n = 0; n < w->ops; n++) {
+        i = rand_r(&seed) % SLOTS;
+        if (w->ptr[i] != NULL) {
+            if (!check_block(w, i))
+                w->errors++;
+            mm_free(w->ptr[i]);
+            w->ptr[i] = NULL;
+        } else {
+            w->size[i] = 1 + rand_r(&seed) % w->max_size;
+            if ((w->ptr[i] = mm_malloc(w->size[i])) == NULL) {
+                w->errors++;
+                continue;
+            }
+            w->ptr[i][0] = w->ptr[i][w->size[i] - 1] = (char)(w->id * SLOTS + i);
+        }
+    }
+
+    /* Free what the thread to the left allocated */
+    pthread_barrier_wait(&barrier);
+    for (i = 0; i < SLOTS; i++) {
+        if (left->ptr[i] != NULL) {
+            if (!check_block(left, i))
+                w->errors++;
+            mm_free(left->ptr[i]);
+            left->ptr[i] = NULL;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * run - One round with n threads, returning its wall time in seconds
+ */
+static double run(int n, long ops, size_t max_size, int *errors)
+{
+    pthread_t tid[MAX_THREADS];
+    struct timespec start, stop;
+    int t;
+
+    mem_reset_brk();
+    if (mm_init() < 0) {
+        fprintf(stderr, "mm_init failed\n");
+        exit(1);
+    }
+    nthreads = n;
+    pthread_barrier_init(&barrier, NULL, n);
+    memset(workers, 0, sizeof(workers));
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (t = 0; t < n; t++) {
+        workers[t].id = t;
+        workers[t].ops = ops;
+        workers[t].max_size = max_size;
+        pthread_create(&tid[t], NULL, worker, &workers[t]);
+    }
+    for (t = 0; t < n; t++) {
+        pthread_join(tid[t], NULL);
+        *errors += workers[t].errors;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    pthread_barrier_destroy(&barrier);
+    return (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) * 1e-9;
+}
+
+static void usage(char *argv[])
+{
+    printf("Usage: %s [-h] [-t <threads>] [-n <ops>] [-s <size>]\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h          Print this help message.\n");
+    printf("  -t <n>      Largest number of threads (default 4)\n");
+    printf("  -n <ops>    Operations per thread (default 1000000)\n");
+    printf("  -s <size>   Largest request in bytes (default 256)\n");
+}
+
+int main(int argc, char *argv[])
+{
+    char c;
+    int n, max_threads = 4, errors = 0;
+    long ops = 1000000;
+    size_t max_size = 256;
+    double secs, base = 0;
+
+    while ((c = getopt(argc, argv, "t:n:s:h")) != -1) {
+        switch (c) {
+        case 't':
+            max_threads = atoi(optarg);
+            break;
+        case 'n':
+            ops = atol(optarg);
+            break;
+        case 's':
+            max_size = atol(optarg);
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+    if (max_threads < 1 || max_threads > MAX_THREADS || ops < 1 || max_size < 1) {
+        usage(argv);
+        exit(1);
+    }
+
+    mem_init();
+    printf("%8s %10s %10s %8s\n", "threads", "secs", "Mops", "speedup");
+    for (n = 1; n <= max_threads; n++) {
+        secs = run(n, ops, max_size, &errors);
+        if (n == 1)
+            base = secs;
+        printf("%8d %10.3f %10.2f %8.2f\n", n, secs, n * ops / secs / 1e6,
+               n * base / secs);
+    }
+    if (errors != 0) {
+        printf("%d blocks were corrupted or not allocated\n", errors);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,156 @@
+/*
+ * perfctr.c - Hardware performance counters via perf_event_open(2)
+ *
+ * Every counter is its own event, so one the PMU lacks does not take
+ * the others down with it. Counts are scaled by enabled/running time
+ * in case the kernel had to multiplex them.
+ */
+#define _GNU_SOURCE /* for syscall() */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include "perfctr.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#endif
+
+static int fds[PERF_NCOUNTERS] = {-1, -1, -1, -1, -1};
+static char status[256] = "perf_init() not called";
+
+static const char *names[PERF_NCOUNTERS] = {
+    "cycles", "instr", "L1D miss", "LLC miss", "dTLB miss"
+};
+
+const char *perf_name(int i)
+{
+    return names[i];
+}
+
+const char *perf_status(void)
+{
+    return status;
+}
+
+#ifdef __linux__
+/* Generic cache event: cache id, read access, miss result */
+#define CACHE_READ_MISS(c) \
+    ((c) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | \
+     (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static int open_counter(unsigned int type, unsigned long long config)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;        /* allowed at perf_event_paranoid 2 */
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                       PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+/*
+ * perf_init - Open whichever counters the kernel and CPU allow
+ */
+int perf_init(void)
+{
+    int i, n = 0;
+#ifdef __linux__
+    const struct { unsigned int type; unsigned long long config; } events[] = {
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+        { PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_L1D) },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+        { PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_DTLB) },
+    };
+    int err = 0;
+
+    for (i = 0; i < PERF_NCOUNTERS; i++) {
+        fds[i] = open_counter(events[i].type, events[i].config);
+        if (fds[i] < 0)
+            err = errno;
+        else
+            n++;
+    }
+    if (n == PERF_NCOUNTERS)
+        status[0] = '\0';
+    else
+        snprintf(status, sizeof(status), "%d of %d counters unavailable (%s)",
+                 PERF_NCOUNTERS - n, PERF_NCOUNTERS, strerror(err));
+#else
+    for (i = 0; i < PERF_NCOUNTERS; i++)
+        fds[i] = -1;
+    snprintf(status, sizeof(status), "perf_event_open is Linux only");
+#endif
+    return n;
+}
+
+static double wall_secs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * perf_measure - Reset and enable the counters, run f(argp) once, and
+ *     read them back
+ */
+void perf_measure(perf_test_funct f, void *argp, perf_sample_t *sample)
+{
+    int i;
+    double start;
+    unsigned long long v[3]; /* value, time enabled, time running */
+
+#ifdef __linux__
+    for (i = 0; i < PERF_NCOUNTERS; i++) {
+        if (fds[i] >= 0) {
+            ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#endif
+    start = wall_secs();
+    f(argp);
+    sample->secs = wall_secs() - start;
+#ifdef __linux__
+    for (i = 0; i < PERF_NCOUNTERS; i++)
+        if (fds[i] >= 0)
+            ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+#endif
+
+    for (i = 0; i < PERF_NCOUNTERS; i++) {
+        sample->valid[i] = 0;
+        sample->count[i] = 0;
+        if (fds[i] < 0 || read(fds[i], v, sizeof(v)) != sizeof(v) || v[2] == 0)
+            continue;
+        sample->valid[i] = 1;
+        sample->count[i] = (v[2] < v[1]) ?
+            (unsigned long long)((double)v[0] * v[1] / v[2]) : v[0];
+    }
+}
+
+/*
+ * perf_close - Release the counters
+ */
+void perf_close(void)
+{
+    int i;
+
+    for (i = 0; i < PERF_NCOUNTERS; i++) {
+        if (fds[i] >= 0)
+            close(fds[i]);
+        fds[i] = -1;
+    }
+}
@@ -0,0 +1,45 @@
+/*
+ * perfctr.h - Hardware performance counters around a test function
+ *
+ * Wraps a function the way fsecs() does and reports what the CPU
+ * counted while it ran: cycles, instructions, L1D, last-level cache
+ * and dTLB misses. Counters that cannot be opened (no PMU in a VM,
+ * a restrictive perf_event_paranoid, no perf_event_open at all) are
+ * left out, and the software clock is always measured.
+ */
+#ifndef PERFCTR_H
+#define PERFCTR_H
+
+typedef void (*perf_test_funct)(void *);
+
+enum {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    PERF_DTLB_MISSES,
+    PERF_NCOUNTERS
+};
+
+typedef struct {
+    double secs;                          /* wall clock, always valid */
+    int valid[PERF_NCOUNTERS];            /* was the counter running? */
+    unsigned long long count[PERF_NCOUNTERS];
+} perf_sample_t;
+
+/* Open the counters; returns how many are available (0 is fine) */
+int perf_init(void);
+
+/* Why counters are missing, or "" if all of them are available */
+const char *perf_status(void);
+
+/* Short column name of counter i */
+const char *perf_name(int i);
+
+/* Run f(argp) once with the counters enabled */
+void perf_measure(perf_test_funct f, void *argp, perf_sample_t *sample);
+
+/* Close the counters */
+void perf_close(void);
+
+#endif /* PERFCTR_H */